@@ -6,18 +6,19 @@
 namespace xll {
 
 	// Individual argument for an add-in function.
+	// Strings are interned since they repeat across add-ins.
 	struct Arg {
 		OPER type, name, help, init;
 
 		template<class T>
 			requires xll::is_char<T>::value
 		Arg(const wchar_t* type, const T* name, const T* help)
-			: type(type), name(name), help(help), init(OPER())
+			: type(intern(type)), name(intern(name)), help(intern(help)), init(OPER())
 		{ }
 		template<class T, class U>
 			requires xll::is_char<T>::value
 		Arg(const wchar_t* type, const T* name, const T* help, U init)
-			: type(type), name(name), help(help), init(init)
+			: type(intern(type)), name(intern(name)), help(intern(help)), init(init)
 		{ }
 	};
 
@@ -117,7 +118,7 @@ X(documentation, xltypeStr,  "Documentation for the function.") \
 		template<class T> requires is_char<T>::value
 		Function(const wchar_t* type, const T* procedure, const T* functionText)
 			: Args{ .procedure = OPER(procedure),
-					.typeText = OPER(type),
+					.typeText = intern(type),
 					.functionText = OPER(functionText),
 					.macroType = OPER(1) }
 		{ }
@@ -128,14 +129,16 @@ X(documentation, xltypeStr,  "Documentation for the function.") \
 		Function& Arguments(const std::initializer_list<Arg>& args)
 		{
 			OPER comma(L"");
+			// Capacity for all arguments after the first append.
+			const int n = xll::size(argumentHelp) + static_cast<int>(args.size());
 			for (const auto& arg : args) {
 				typeText &= arg.type;
 				argumentText &= (comma & arg.name);
 
-				argumentHelp.append(arg.help);
-				argumentType.append(arg.type);
-				argumentName.append(arg.name);	
-				argumentInit.append(arg.init);
+				argumentHelp.append(arg.help).reserve(n);
+				argumentType.append(arg.type).reserve(n);
+				argumentName.append(arg.name).reserve(n);
+				argumentInit.append(arg.init).reserve(n);
 
 				comma = OPER(L", ");
 			}
@@ -145,7 +148,7 @@ X(documentation, xltypeStr,  "Documentation for the function.") \
 		template<class T> requires is_char<T>::value
 		Function& Category(const T* category_)
 		{
-			category = category_;
+			category = intern(category_);
 
 			return *this;
 		}
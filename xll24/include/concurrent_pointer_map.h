@@ -0,0 +1,392 @@
+// concurrent_pointer_map.h - Pointer keyed hash table with wait-free reads.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Readers take no locks and never retry. Writers are serialized by a mutex.
+// Erased keys leave tombstones that are reused by inserts and dropped when the
+// table is rebuilt. Replaced tables are freed once no reader can still see them.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace xll {
+
+	namespace detail {
+		struct alignas(64) epoch_slot {
+			std::atomic<uint64_t> e = 0; // announced epoch, 0 if not reading
+			std::atomic<bool> used = false;
+		};
+	}
+
+	// Epoch based reclamation. A reader announces the epoch it started in and
+	// memory retired in an earlier epoch is freed once every reader has moved on.
+	class epoch {
+		static constexpr unsigned max_threads = 1024;
+		using slot = detail::epoch_slot;
+		struct retired {
+			uint64_t e;
+			void* p;
+			void (*free)(void*);
+		};
+		struct local {
+			slot* s = nullptr;
+			unsigned depth = 0;
+
+			local()
+			{
+				for (unsigned i = 0; i < max_threads && !s; ++i) {
+					bool used = false;
+					if (slots[i].used.compare_exchange_strong(used, true)) {
+						s = &slots[i];
+						// Writers scan slots below high.
+						unsigned h = high.load();
+						while (h < i + 1 && !high.compare_exchange_weak(h, i + 1)) {
+						}
+					}
+				}
+			}
+			~local()
+			{
+				if (s) {
+					s->used.store(false, std::memory_order_release);
+				}
+			}
+		};
+
+		inline static slot slots[max_threads];
+		inline static std::atomic<unsigned> high = 0; // slots ever claimed
+		inline static std::atomic<unsigned> overflow = 0; // readers without a slot
+		inline static std::atomic<uint64_t> global = 1;
+		inline static std::mutex m;
+		// Blocks left at unload are freed with the DLL.
+		struct retired_list : std::vector<retired> {
+			~retired_list()
+			{
+				for (auto& r : *this) {
+					r.free(r.p);
+				}
+			}
+		};
+		inline static retired_list garbage;
+
+		static local& self()
+		{
+			static thread_local local l;
+
+			return l;
+		}
+		// Free memory no reader can see. Called with m held.
+		static void reclaim()
+		{
+			if (overflow.load() != 0) {
+				return;
+			}
+			uint64_t oldest = UINT64_MAX;
+			const unsigned n = high.load();
+			for (unsigned i = 0; i < n; ++i) {
+				const uint64_t e = slots[i].e.load();
+				if (e && e < oldest) {
+					oldest = e;
+				}
+			}
+			std::erase_if(garbage, [oldest](const retired& r) {
+				if (r.e < oldest) {
+					r.free(r.p);
+					return true;
+				}
+				return false;
+			});
+		}
+	public:
+		// Announce a read for the lifetime of the guard. Guards can nest.
+		class guard {
+			local& l;
+		public:
+			guard()
+				: l(self())
+			{
+				if (l.depth++ == 0) {
+					if (l.s) {
+						l.s->e.store(global.load(std::memory_order_acquire), std::memory_order_relaxed);
+					}
+					else {
+						overflow.fetch_add(1);
+					}
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+				}
+			}
+			guard(const guard&) = delete;
+			guard& operator=(const guard&) = delete;
+			~guard()
+			{
+				if (--l.depth == 0) {
+					if (l.s) {
+						l.s->e.store(0, std::memory_order_release);
+					}
+					else {
+						overflow.fetch_sub(1, std::memory_order_release);
+					}
+				}
+			}
+		};
+
+		// Free p after readers that might see it are done. Call after p is unreachable.
+		template<class T>
+		static void retire(T* p)
+		{
+			std::lock_guard lock(m);
+			garbage.push_back({ global.fetch_add(1), p, [](void* p) { delete static_cast<T*>(p); } });
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			reclaim();
+		}
+		// Number of retired blocks not yet freed.
+		static size_t pending()
+		{
+			std::lock_guard lock(m);
+			reclaim();
+
+			return garbage.size();
+		}
+	};
+
+	// Values are stored inline and must fit in an atomic word.
+	template<class V>
+		requires std::is_trivially_copyable_v<V> && (sizeof(V) <= sizeof(uintptr_t))
+	class concurrent_pointer_map {
+		static constexpr uintptr_t empty = 0;
+		static constexpr uintptr_t erased = 1; // not an object address
+
+		struct slot {
+			std::atomic<uintptr_t> key = empty;
+			std::atomic<V> value = V{};
+		};
+		struct table {
+			size_t mask;
+			int shift;
+			std::unique_ptr<slot[]> s;
+
+			explicit table(size_t cap)
+				: mask(cap - 1), shift(64 - std::countr_zero(cap)), s(std::make_unique<slot[]>(cap))
+			{ }
+			// Fibonacci hashing. Heap pointers have low bits zero.
+			size_t home(uintptr_t k) const noexcept
+			{
+				return static_cast<size_t>((static_cast<uint64_t>(k) * 0x9E3779B97F4A7C15ull) >> shift);
+			}
+		};
+
+		std::atomic<table*> t = nullptr;
+		std::atomic<size_t> n = 0; // keys
+		size_t used = 0; // keys and tombstones
+		mutable std::mutex m;
+
+		static uintptr_t key(const void* p) noexcept
+		{
+			return reinterpret_cast<uintptr_t>(p);
+		}
+		// Slot holding k or nullptr. Called with m held.
+		slot* lookup(uintptr_t k) const noexcept
+		{
+			table* pt = t.load(std::memory_order_relaxed);
+			if (!pt || k <= erased) {
+				return nullptr;
+			}
+			for (size_t i = pt->home(k); ; i = (i + 1) & pt->mask) {
+				const uintptr_t ki = pt->s[i].key.load(std::memory_order_relaxed);
+				if (ki == empty) {
+					return nullptr;
+				}
+				if (ki == k) {
+					return &pt->s[i];
+				}
+			}
+		}
+		// Publish a table without tombstones. Called with m held.
+		table* rehash()
+		{
+			table* pt = t.load(std::memory_order_relaxed);
+			auto pt_ = std::make_unique<table>(std::bit_ceil(std::max<size_t>(16, 2 * (n + 1))));
+			if (pt) {
+				for (size_t i = 0; i <= pt->mask; ++i) {
+					const uintptr_t k = pt->s[i].key.load(std::memory_order_relaxed);
+					if (k > erased) {
+						size_t j = pt_->home(k);
+						while (pt_->s[j].key.load(std::memory_order_relaxed) != empty) {
+							j = (j + 1) & pt_->mask;
+						}
+						pt_->s[j].value.store(pt->s[i].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+						pt_->s[j].key.store(k, std::memory_order_relaxed);
+					}
+				}
+			}
+			used = n;
+			t.store(pt_.get(), std::memory_order_release);
+			if (pt) {
+				epoch::retire(pt);
+			}
+
+			return pt_.release();
+		}
+	public:
+		constexpr concurrent_pointer_map() noexcept = default;
+		concurrent_pointer_map(const concurrent_pointer_map&) = delete;
+		concurrent_pointer_map& operator=(const concurrent_pointer_map&) = delete;
+		// No readers are left when the map is destroyed.
+		~concurrent_pointer_map()
+		{
+			delete t.load();
+		}
+
+		size_t size() const noexcept
+		{
+			return n.load(std::memory_order_relaxed);
+		}
+
+		// Copy the value of p to v. Wait-free.
+		bool find(const void* p, V& v) const noexcept
+		{
+			const uintptr_t k = key(p);
+			if (k <= erased) {
+				return false;
+			}
+
+			epoch::guard g;
+			const table* pt = t.load(std::memory_order_acquire);
+			if (!pt) {
+				return false;
+			}
+			for (size_t i = pt->home(k), j = 0; j <= pt->mask; i = (i + 1) & pt->mask, ++j) {
+				const uintptr_t ki = pt->s[i].key.load(std::memory_order_acquire);
+				if (ki == empty) {
+					return false;
+				}
+				if (ki == k) {
+					v = pt->s[i].value.load(std::memory_order_acquire);
+					// The slot was not erased and reused while reading.
+					return pt->s[i].key.load(std::memory_order_relaxed) == k;
+				}
+			}
+
+			return false;
+		}
+		bool contains(const void* p) const noexcept
+		{
+			V v;
+
+			return find(p, v);
+		}
+
+		// Insert v if p is not a key. Null pointers are not stored.
+		bool insert(const void* p, V v)
+		{
+			const uintptr_t k = key(p);
+			if (k <= erased) {
+				return false;
+			}
+
+			std::lock_guard lock(m);
+			table* pt = t.load(std::memory_order_relaxed);
+			if (!pt || 4 * (used + 1) > 3 * (pt->mask + 1)) {
+				pt = rehash();
+			}
+			slot* ps = nullptr; // first tombstone
+			size_t i = pt->home(k);
+			for (uintptr_t ki; (ki = pt->s[i].key.load(std::memory_order_relaxed)) != empty; i = (i + 1) & pt->mask) {
+				if (ki == k) {
+					return false;
+				}
+				if (ki == erased && !ps) {
+					ps = &pt->s[i];
+				}
+			}
+			if (!ps) {
+				ps = &pt->s[i];
+				++used;
+			}
+			// Readers that see the key see the value.
+			ps->value.store(v, std::memory_order_release);
+			ps->key.store(k, std::memory_order_release);
+			n.fetch_add(1, std::memory_order_relaxed);
+
+			return true;
+		}
+		// Set the value of an existing key.
+		bool assign(const void* p, V v)
+		{
+			std::lock_guard lock(m);
+			slot* ps = lookup(key(p));
+			if (!ps) {
+				return false;
+			}
+			ps->value.store(v, std::memory_order_release);
+
+			return true;
+		}
+		bool erase(const void* p)
+		{
+			std::lock_guard lock(m);
+			slot* ps = lookup(key(p));
+			if (!ps) {
+				return false;
+			}
+			ps->key.store(erased, std::memory_order_release);
+			n.fetch_sub(1, std::memory_order_relaxed);
+
+			return true;
+		}
+		// Call f(p, v) for every key. Writers wait until f returns.
+		template<class F>
+		void for_each(F&& f) const
+		{
+			std::lock_guard lock(m);
+			const table* pt = t.load(std::memory_order_relaxed);
+			for (size_t i = 0; pt && i <= pt->mask; ++i) {
+				const uintptr_t k = pt->s[i].key.load(std::memory_order_relaxed);
+				if (k > erased) {
+					f(reinterpret_cast<const void*>(k), pt->s[i].value.load(std::memory_order_relaxed));
+				}
+			}
+		}
+		void clear()
+		{
+			std::lock_guard lock(m);
+			if (table* pt = t.exchange(nullptr)) {
+				epoch::retire(pt);
+			}
+			n = 0;
+			used = 0;
+		}
+	};
+
+	class concurrent_pointer_set {
+		concurrent_pointer_map<bool> m;
+	public:
+		constexpr concurrent_pointer_set() noexcept = default;
+
+		size_t size() const noexcept
+		{
+			return m.size();
+		}
+		bool contains(const void* p) const noexcept
+		{
+			return m.contains(p);
+		}
+		bool insert(const void* p)
+		{
+			return m.insert(p, true);
+		}
+		bool erase(const void* p)
+		{
+			return m.erase(p);
+		}
+		void clear()
+		{
+			m.clear();
+		}
+	};
+
+} // namespace xll
@@ -3,30 +3,66 @@
 // https://xlladdins.github.io/Excel4Macros/
 #pragma once
 #include <array>
+#include <type_traits>
 #include "oper.h"
 
 namespace xll {
 
+	// Pointers to Excel arguments. XLOPER12s are not copied.
+	template<size_t M, size_t N>
+	class excel_args {
+		std::array<OPER, M> os; // converted scalars and literals
+		XLOPER12 xs[N];         // copies of structs with xlbitFree cleared
+		size_t m = 0, n = 0;
+	public:
+		template<class T>
+		LPXLOPER12 operator()(T&& t)
+		{
+			if constexpr (std::is_base_of_v<XLOPER12, std::remove_cvref_t<T>>) {
+				const XLOPER12& x = t;
+				if (x.xltype == type(x)) {
+					return const_cast<LPXLOPER12>(&x);
+				}
+				xs[n] = x;
+				xs[n].xltype = type(x);
+
+				return &xs[n++];
+			}
+			else {
+				os[m] = OPER(std::forward<T>(t));
+
+				return &os[m++];
+			}
+		}
+	};
+
+	// Copy of Excel result. Arrays use a single allocation.
+	// Results are not moved out so an OPER never holds memory Excel must free.
+	// XLL.BENCH.EXCEL.RESULT times the copy.
+	inline OPER excel_result(XLOPER12& res)
+	{
+		OPER o = type(res) == xltypeMulti ? arena(res) : OPER(res);
+		if (isAlloc(res)) {
+			::Excel12(xlFree, 0, 1, &res);
+		}
+
+		return o;
+	}
+
 	template<class... Ts>
 	inline OPER Excel(int fn, Ts&&... ts)
 	{
 		XLOPER12 res = { .xltype = xltypeNil };
 
-		std::array os{std::move(OPER(ts))...};
-		LPXLOPER12 pos[sizeof...(ts)]; // must be native XLOPER12
-		for (size_t i = 0; i < os.size(); ++i) {
-			pos[i] = &os[i];
-		}
+		constexpr size_t M = (0 + ... + !std::is_base_of_v<XLOPER12, std::remove_cvref_t<Ts>>);
+		excel_args<M, sizeof...(Ts)> args;
+		LPXLOPER12 pos[] = { args(std::forward<Ts>(ts))... }; // evaluated in order
 		// Heap corruption if OPER address passed for res.
 		int ret = ::Excel12v(fn, &res, sizeof...(ts), &pos[0]);
 		ensure_ret(ret);
 		// ensure_err(res); // allow xltypeErr to be returned
-		OPER o(res);
-		if (isAlloc(res)) {
-			::Excel12(xlFree, 0, 1, &res);
-		}
 
-		return o;
+		return excel_result(res);
 	}
 	
 	inline OPER Excel(int fn)
@@ -35,12 +71,8 @@ namespace xll {
 
 		const int ret = ::Excel12v(fn, &res, 0, nullptr);
 		ensure_ret(ret);
-		OPER o(res);
-		if (isAlloc(res)) {
-			::Excel12(xlFree, 0, 1, &res);
-		}
 
-		return o;
+		return excel_result(res);
 	}
 	
 } // namespace xll
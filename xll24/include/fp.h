@@ -2,10 +2,16 @@
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
 #include <algorithm>
+#include <array>
+#include <compare>
 #include <initializer_list>
-//#include <mdspan>
+#include <iterator>
 #include <span>
 #include <stdexcept>
+#include <version>
+#if __has_include(<mdspan>)
+#include <mdspan>
+#endif
 #include "ensure.h"
 extern "C" {
 #include "fpx.h"
@@ -61,16 +67,198 @@ namespace xll {
 	{
 		return std::span<const double>(array(a) + i * columns(a), columns(a));
 	}
-	/*
+
+	// View of every stride-th element. Used for columns when <mdspan> is not available.
+	template<class T>
+	class strided_span {
+		T* p;
+		int n;
+		int stride;
+	public:
+		class iterator {
+			T* p;
+			int stride;
+		public:
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type = std::remove_cv_t<T>;
+			using difference_type = std::ptrdiff_t;
+			using pointer = T*;
+			using reference = T&;
+
+			constexpr iterator(T* p = nullptr, int stride = 1) noexcept
+				: p(p), stride(stride)
+			{ }
+			constexpr T& operator*() const noexcept
+			{
+				return *p;
+			}
+			constexpr T& operator[](difference_type i) const noexcept
+			{
+				return p[i * stride];
+			}
+			constexpr iterator& operator++() noexcept
+			{
+				p += stride;
+
+				return *this;
+			}
+			constexpr iterator operator++(int) noexcept
+			{
+				auto i = *this;
+				p += stride;
+
+				return i;
+			}
+			constexpr iterator& operator--() noexcept
+			{
+				p -= stride;
+
+				return *this;
+			}
+			constexpr iterator operator--(int) noexcept
+			{
+				auto i = *this;
+				p -= stride;
+
+				return i;
+			}
+			constexpr iterator& operator+=(difference_type i) noexcept
+			{
+				p += i * stride;
+
+				return *this;
+			}
+			constexpr iterator& operator-=(difference_type i) noexcept
+			{
+				p -= i * stride;
+
+				return *this;
+			}
+			constexpr iterator operator+(difference_type i) const noexcept
+			{
+				return iterator(p + i * stride, stride);
+			}
+			friend constexpr iterator operator+(difference_type i, const iterator& j) noexcept
+			{
+				return j + i;
+			}
+			constexpr iterator operator-(difference_type i) const noexcept
+			{
+				return iterator(p - i * stride, stride);
+			}
+			constexpr difference_type operator-(const iterator& i) const noexcept
+			{
+				return (p - i.p) / stride;
+			}
+			constexpr bool operator==(const iterator& i) const noexcept
+			{
+				return p == i.p;
+			}
+			constexpr auto operator<=>(const iterator& i) const noexcept
+			{
+				return p <=> i.p;
+			}
+		};
+
+		constexpr strided_span(T* p = nullptr, int n = 0, int stride = 1) noexcept
+			: p(p), n(n), stride(stride)
+		{ }
+
+		constexpr int size() const noexcept
+		{
+			return n;
+		}
+		constexpr T& operator[](int i) const noexcept
+		{
+			return p[i * stride];
+		}
+		constexpr iterator begin() const noexcept
+		{
+			return iterator(p, stride);
+		}
+		constexpr iterator end() const noexcept
+		{
+			return iterator(p + n * stride, stride);
+		}
+	};
+
 	constexpr auto column(FP12& a, int j) noexcept
 	{
-		return std::mdspan<double>(array(a) + j, rows(a));
+		return strided_span<double>(array(a) + j, rows(a), columns(a));
 	}
 	constexpr auto column(const FP12& a, int j) noexcept
 	{
-		return std::mdspan<const double>(array(a) + j, rows(a));
+		return strided_span<const double>(array(a) + j, rows(a), columns(a));
+	}
+
+	// Rows i to i + r and columns j to j + c of an array with ld columns.
+	// Same extent and stride names as std::mdspan.
+	template<class T>
+	class block_view {
+		T* p;
+		int r, c, ld;
+	public:
+		constexpr block_view(T* p, int r, int c, int ld) noexcept
+			: p(p), r(r), c(c), ld(ld)
+		{ }
+
+		constexpr int extent(int k) const noexcept
+		{
+			return k == 0 ? r : c;
+		}
+		constexpr int stride(int k) const noexcept
+		{
+			return k == 0 ? ld : 1;
+		}
+		constexpr T& operator()(int i, int j) const noexcept
+		{
+			return p[i * ld + j];
+		}
+		constexpr std::span<T> row(int i) const noexcept
+		{
+			return std::span<T>(p + i * ld, c);
+		}
+		constexpr strided_span<T> column(int j) const noexcept
+		{
+			return strided_span<T>(p + j, r, ld);
+		}
+		constexpr block_view block(int i, int j, int r_, int c_) const noexcept
+		{
+			return block_view(p + i * ld + j, r_, c_, ld);
+		}
+#ifdef __cpp_lib_mdspan
+		constexpr auto mdspan() const noexcept
+		{
+			using extents = std::dextents<int, 2>;
+			using mapping = std::layout_stride::mapping<extents>;
+
+			return std::mdspan<T, extents, std::layout_stride>(p, mapping(extents(r, c), std::array<int, 2>{ ld, 1 }));
+		}
+#endif // __cpp_lib_mdspan
+	};
+
+	constexpr auto block(FP12& a, int i, int j, int r, int c) noexcept
+	{
+		return block_view<double>(array(a) + i * columns(a) + j, r, c, columns(a));
+	}
+	constexpr auto block(const FP12& a, int i, int j, int r, int c) noexcept
+	{
+		return block_view<const double>(array(a) + i * columns(a) + j, r, c, columns(a));
+	}
+
+#ifdef __cpp_lib_mdspan
+	// Row major view of the whole array.
+	constexpr auto mdspan(FP12& a) noexcept
+	{
+		return std::mdspan<double, std::dextents<int, 2>>(array(a), rows(a), columns(a));
+	}
+	constexpr auto mdspan(const FP12& a) noexcept
+	{
+		return std::mdspan<const double, std::dextents<int, 2>>(array(a), rows(a), columns(a));
 	}
-	*/
+#endif // __cpp_lib_mdspan
+
 	constexpr double* begin(FP12& a) noexcept
 	{
 		return array(a);
@@ -95,9 +283,47 @@ namespace xll {
 		return x;
 	}
 
+	// FPX arrays created on this thread while in scope use allocator a.
+	class fpx_allocator_scope {
+		const fpx_allocator* a;
+	public:
+		explicit fpx_allocator_scope(const fpx_allocator& a)
+			: a(fpx_set_allocator(&a))
+		{ }
+		fpx_allocator_scope(const fpx_allocator_scope&) = delete;
+		fpx_allocator_scope& operator=(const fpx_allocator_scope&) = delete;
+		~fpx_allocator_scope()
+		{
+			fpx_set_allocator(a);
+		}
+	};
+
+	// Element-wise expressions from fp_expr.h with rows(), columns() and operator[].
+	template<class E>
+	concept fp_expression = requires { typename E::is_fp_expression; };
+
+	class FPX;
+	FPX hstack(std::span<const _FP12* const> as);
 
 	class FPX {
 		struct fpx* fpx_;
+
+		template<class E>
+		void assign(const E& e) noexcept
+		{
+			double* a = array();
+			const int n = size();
+			for (int i = 0; i < n; ++i) {
+				a[i] = e[i];
+			}
+		}
+		// Grow capacity geometrically to hold at least n elements.
+		void expand(int n)
+		{
+			if (n > capacity()) {
+				reserve(std::max(n, 2 * capacity()));
+			}
+		}
 	public:
 		FPX(int r = 0, int c = 0)
 			: fpx_(fpx_malloc(r, c))
@@ -124,10 +350,19 @@ namespace xll {
 		FPX(const FPX& a)
 			: FPX(a.rows(), a.columns(), a.array())
 		{ }
+		// Evaluate an expression in one loop.
+		template<class E>
+			requires fp_expression<E>
+		FPX(const E& e)
+			: FPX(e.rows(), e.columns())
+		{
+			assign(e);
+		}
 		// Construct from iterable
 		template<class I>
 			requires std::is_same_v<double, std::iter_value_t<I>>
 		FPX(I i)
+			: FPX()
 		{
 			while (i) {
 				append(*i);
@@ -157,6 +392,16 @@ namespace xll {
 
 			return *this;
 		}
+		// Elements may appear in e since each is read before it is written.
+		template<class E>
+			requires fp_expression<E>
+		FPX& operator=(const E& e)
+		{
+			resize(e.rows(), e.columns());
+			assign(e);
+
+			return *this;
+		}
 		FPX& operator=(FPX&& a) noexcept
 		{
 			if (this != &a) {
@@ -183,6 +428,27 @@ namespace xll {
 		{
 			return rows() * columns();
 		}
+		// Number of elements that fit without reallocating.
+		int capacity() const noexcept
+		{
+			return fpx_capacity(fpx_);
+		}
+		FPX& reserve(int n)
+		{
+			auto _fpx = fpx_reserve(fpx_, n);
+			ensure(_fpx);
+			fpx_ = _fpx;
+
+			return *this;
+		}
+		FPX& shrink_to_fit()
+		{
+			auto _fpx = fpx_shrink_to_fit(fpx_);
+			ensure(_fpx);
+			fpx_ = _fpx;
+
+			return *this;
+		}
 		double* array() noexcept
 		{
 			return (size() && fpx_) ? fpx_->array : nullptr;
@@ -227,17 +493,12 @@ namespace xll {
 			return xll::index(*get(), i, j);
 		}
 
+		// Keeps capacity when shrinking.
 		FPX& resize(int r, int c)
 		{
-			if (r * c != size()) {
-				auto _fpx = fpx_realloc(fpx_, r, c);
-				ensure(_fpx);
-				fpx_ = _fpx;
-			}
-			else {
-				fpx_->rows = r;
-				fpx_->columns = c;
-			}
+			auto _fpx = fpx_realloc(fpx_, r, c);
+			ensure(_fpx);
+			fpx_ = _fpx;
 
 			return *this;
 		}
@@ -261,10 +522,14 @@ namespace xll {
 			if (size() == 0) {
 				operator=(a);
 			}
+			else if (&a == get()) {
+				return vstack(FPX(a));
+			}
 			else {
 				ensure(columns() == a.columns);
 
 				int n = size();
+				expand(n + a.rows * a.columns);
 				resize(rows() + a.rows, columns());
 				std::copy_n(a.array, a.rows * a.columns, fpx_->array + n);
 			}
@@ -273,22 +538,18 @@ namespace xll {
 		}
 		FPX& vstack(const FPX& a)
 		{
-			return vstack(*a.get());
+			return vstack(static_cast<const _FP12&>(a));
 		}
 
+		// Allocate once and copy rows of *this and a in one pass.
 		FPX& hstack(const _FP12& a)
 		{
 			if (size() == 0) {
 				operator=(a);
 			}
 			else {
-				// !!! not efficient
-				FPX a_(*this);
-				a_.transpose();
-				FPX _a(a);
-				_a.transpose();
-				a_.vstack(_a);
-				a_.transpose();
+				const _FP12* as[] = { get(), &a };
+				FPX a_ = xll::hstack(as);
 				swap(a_);
 			}
 
@@ -296,7 +557,7 @@ namespace xll {
 		}
 		FPX& hstack(const FPX& a)
 		{
-			return hstack(*a.get());
+			return hstack(static_cast<const _FP12&>(a));
 		}
 
 		// Only works for vector arrays
@@ -305,6 +566,7 @@ namespace xll {
 			auto n = size();
 			ensure(n == 0 || rows() == 1 || columns() == 1);
 
+			expand(n + 1);
 			if (n == 0) {
 				resize(1, 1);
 				operator[](0) = x;
@@ -325,6 +587,70 @@ namespace xll {
 
 	using FP12 = FPX;
 
+	// Concatenate arrays with the same number of columns in one allocation.
+	// Empty arrays are skipped.
+	inline FPX vstack(std::span<const _FP12* const> as)
+	{
+		int r = 0, c = 0;
+		for (const _FP12* a : as) {
+			if (size(*a)) {
+				ensure(c == 0 || c == a->columns || !"vstack: arrays must have the same number of columns");
+				c = a->columns;
+				r += a->rows;
+			}
+		}
+
+		FPX x(r, c);
+		double* px = x.array();
+		for (const _FP12* a : as) {
+			px = std::copy_n(a->array, size(*a), px);
+		}
+
+		return x;
+	}
+	// Concatenate arrays with the same number of rows in one allocation.
+	// Empty arrays are skipped.
+	inline FPX hstack(std::span<const _FP12* const> as)
+	{
+		int r = 0, c = 0;
+		for (const _FP12* a : as) {
+			if (size(*a)) {
+				ensure(r == 0 || r == a->rows || !"hstack: arrays must have the same number of rows");
+				r = a->rows;
+				c += a->columns;
+			}
+		}
+
+		FPX x(r, c);
+		double* px = x.array();
+		// Rows of the result are written in order.
+		for (int i = 0; i < r; ++i) {
+			for (const _FP12* a : as) {
+				if (size(*a)) {
+					px = std::copy_n(a->array + i * a->columns, a->columns, px);
+				}
+			}
+		}
+
+		return x;
+	}
+	template<class... A>
+		requires (std::is_convertible_v<const A&, const _FP12&> && ...)
+	inline FPX vstack(const A&... a)
+	{
+		const _FP12* as[] = { &static_cast<const _FP12&>(a)... };
+
+		return vstack(std::span<const _FP12* const>(as));
+	}
+	template<class... A>
+		requires (std::is_convertible_v<const A&, const _FP12&> && ...)
+	inline FPX hstack(const A&... a)
+	{
+		const _FP12* as[] = { &static_cast<const _FP12&>(a)... };
+
+		return hstack(std::span<const _FP12* const>(as));
+	}
+
 	// Fixed size array.
 	template<size_t N, size_t M>
 	struct fp12 {
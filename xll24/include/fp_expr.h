@@ -0,0 +1,223 @@
+// fp_expr.h - Element-wise arithmetic on FPX arrays with expression templates.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Operators build a small tree of views and scalars. Assigning it to an FPX
+// evaluates every element in one loop with a single allocation.
+// Expressions refer to their arrays so evaluate them in the same statement.
+#pragma once
+#include <cmath>
+#include <functional>
+#include <type_traits>
+#include "fp.h"
+
+namespace xll {
+
+	// View of an array in an expression.
+	class fp_ref {
+		const double* a;
+		int r, c;
+	public:
+		using is_fp_expression = void;
+
+		constexpr fp_ref(const double* a, int r, int c) noexcept
+			: a(a), r(r), c(c)
+		{ }
+		constexpr fp_ref(const _FP12& a) noexcept
+			: fp_ref(a.array, a.rows, a.columns)
+		{ }
+		constexpr int rows() const noexcept
+		{
+			return r;
+		}
+		constexpr int columns() const noexcept
+		{
+			return c;
+		}
+		constexpr double operator[](int i) const noexcept
+		{
+			return a[i];
+		}
+	};
+
+	// Number broadcast to the shape of the other operand.
+	struct fp_scalar {
+		double x;
+
+		constexpr double operator[](int) const noexcept
+		{
+			return x;
+		}
+	};
+
+	// Start an expression from an FP12 argument.
+	constexpr fp_ref expr(const _FP12& a) noexcept
+	{
+		return fp_ref(a);
+	}
+	inline fp_ref expr(const FPX& a) noexcept
+	{
+		return fp_ref(a.array(), a.rows(), a.columns());
+	}
+	template<class E>
+		requires fp_expression<E>
+	constexpr const E& expr(const E& e) noexcept
+	{
+		return e;
+	}
+	constexpr fp_scalar expr(double x) noexcept
+	{
+		return fp_scalar{ x };
+	}
+
+	// Array or expression operand.
+	template<class T>
+	concept fp_array = fp_expression<T> || std::is_same_v<T, FPX>;
+	// Operand that may be a number.
+	template<class T>
+	concept fp_operand = fp_array<T> || std::is_arithmetic_v<T>;
+
+	template<class F, class E>
+	class fp_unary {
+		E e;
+	public:
+		using is_fp_expression = void;
+
+		constexpr fp_unary(const E& e)
+			: e(e)
+		{ }
+		constexpr int rows() const noexcept
+		{
+			return e.rows();
+		}
+		constexpr int columns() const noexcept
+		{
+			return e.columns();
+		}
+		constexpr double operator[](int i) const
+		{
+			return F{}(e[i]);
+		}
+	};
+
+	template<class F, class L, class R>
+	class fp_binary {
+		L l;
+		R r;
+		// Operand giving the shape.
+		constexpr const auto& shape() const noexcept
+		{
+			if constexpr (std::is_same_v<L, fp_scalar>) {
+				return r;
+			}
+			else {
+				return l;
+			}
+		}
+	public:
+		using is_fp_expression = void;
+
+		constexpr fp_binary(const L& l, const R& r)
+			: l(l), r(r)
+		{
+			if constexpr (!std::is_same_v<L, fp_scalar> && !std::is_same_v<R, fp_scalar>) {
+				ensure((l.rows() == r.rows() && l.columns() == r.columns()) || !"fp_binary: arrays must have the same shape");
+			}
+		}
+		constexpr int rows() const noexcept
+		{
+			return shape().rows();
+		}
+		constexpr int columns() const noexcept
+		{
+			return shape().columns();
+		}
+		constexpr double operator[](int i) const
+		{
+			return F{}(l[i], r[i]);
+		}
+	};
+
+	template<class F, class L, class R>
+	constexpr auto fp_binary_expr(const L& l, const R& r)
+	{
+		using L_ = std::remove_cvref_t<decltype(expr(l))>;
+		using R_ = std::remove_cvref_t<decltype(expr(r))>;
+
+		return fp_binary<F, L_, R_>(expr(l), expr(r));
+	}
+
+#define XLL_FP_BINARY_OPERATOR(op, F) \
+	template<class L, class R> \
+		requires fp_operand<L> && fp_operand<R> && (fp_array<L> || fp_array<R>) \
+	constexpr auto operator op(const L& l, const R& r) \
+	{ \
+		return fp_binary_expr<F>(l, r); \
+	} \
+	template<class E> \
+		requires fp_operand<E> \
+	inline FPX& operator op##=(FPX& a, const E& e) \
+	{ \
+		return a = fp_binary_expr<F>(a, e); \
+	}
+	XLL_FP_BINARY_OPERATOR(+, std::plus<>)
+	XLL_FP_BINARY_OPERATOR(-, std::minus<>)
+	XLL_FP_BINARY_OPERATOR(*, std::multiplies<>)
+	XLL_FP_BINARY_OPERATOR(/, std::divides<>)
+#undef XLL_FP_BINARY_OPERATOR
+
+	template<class E>
+		requires fp_array<E>
+	constexpr auto operator-(const E& e)
+	{
+		return fp_unary<std::negate<>, std::remove_cvref_t<decltype(expr(e))>>(expr(e));
+	}
+
+	// Element-wise functions, e.g. xll::exp(a).
+	// name, function of double
+#define XLL_FP_UNARY(X) \
+	X(abs, std::fabs)       \
+	X(sqrt, std::sqrt)      \
+	X(exp, std::exp)        \
+	X(log, std::log)        \
+	X(sin, std::sin)        \
+	X(cos, std::cos)        \
+	X(tan, std::tan)        \
+	X(erf, std::erf)        \
+	X(erfc, std::erfc)      \
+	X(tgamma, std::tgamma)  \
+	X(lgamma, std::lgamma)  \
+	X(floor, std::floor)    \
+	X(ceil, std::ceil)      \
+
+#define XLL_FP_FUNCTION(f, g) \
+	struct fp_##f { \
+		double operator()(double x) const { return g(x); } \
+	}; \
+	template<class E> \
+		requires fp_array<E> \
+	constexpr auto f(const E& e) \
+	{ \
+		return fp_unary<fp_##f, std::remove_cvref_t<decltype(expr(e))>>(expr(e)); \
+	}
+	XLL_FP_UNARY(XLL_FP_FUNCTION)
+#undef XLL_FP_FUNCTION
+
+	// name, function of two doubles
+#define XLL_FP_BINARY(X) \
+	X(pow, std::pow)   \
+	X(fmin, std::fmin) \
+	X(fmax, std::fmax) \
+
+#define XLL_FP_FUNCTION(f, g) \
+	struct fp_##f { \
+		double operator()(double x, double y) const { return g(x, y); } \
+	}; \
+	template<class L, class R> \
+		requires fp_operand<L> && fp_operand<R> && (fp_array<L> || fp_array<R>) \
+	constexpr auto f(const L& l, const R& r) \
+	{ \
+		return fp_binary_expr<fp_##f>(l, r); \
+	}
+	XLL_FP_BINARY(XLL_FP_FUNCTION)
+#undef XLL_FP_FUNCTION
+
+} // namespace xll
@@ -0,0 +1,146 @@
+// fp_oper.h - Bulk conversion between OPER and FP12 arrays.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Doubles are copied and xltype checked in one branch free loop. Only ranges
+// that are not all numbers take a second pass to apply the policy.
+#pragma once
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "fp.h"
+#include "oper.h"
+
+namespace xll {
+
+	// How to convert elements that are not xltypeNum, including Bool and Int.
+	enum class convert_policy {
+		nan,   // NaN, or #NUM! when converting NaN to OPER
+		skip,  // leave out, or Nil when converting NaN to OPER
+		error, // throw
+	};
+
+	// Number of elements of a with xltypeNum.
+	inline int count_num(const XLOPER12* a, int n) noexcept
+	{
+		int k = 0;
+		for (int i = 0; i < n; ++i) {
+			k += (a[i].xltype == xltypeNum);
+		}
+
+		return k;
+	}
+	inline int count_num(const XLOPER12& x) noexcept
+	{
+		return isMulti(x) ? count_num(x.val.array.lparray, size(x)) : isNum(x);
+	}
+
+	namespace detail {
+		[[noreturn]] inline void convert_error(const char* what, int i, int c)
+		{
+			throw std::runtime_error(std::string(what) + ": element (" + std::to_string(i / c) + ", "
+				+ std::to_string(i % c) + ") is not a number");
+		}
+	}
+
+	// Convert x to doubles in a. Skipped elements give a single column,
+	// or a single row if x is a row.
+	inline FPX& to_fp(const XLOPER12& x, FPX& a, convert_policy p = convert_policy::nan)
+	{
+		const XLOPER12* xs = isMulti(x) ? x.val.array.lparray : &x;
+		const int r = isMulti(x) ? rows(x) : 1;
+		const int c = isMulti(x) ? columns(x) : 1;
+		const int n = r * c;
+
+		// Copy and count numbers in one pass for the common all numeric case.
+		a.resize(r, c);
+		double* pa = a.array();
+		int k = 0;
+		if (isMulti(x) || isNum(x)) {
+			for (int i = 0; i < n; ++i) {
+				pa[i] = xs[i].val.num;
+				k += (xs[i].xltype == xltypeNum);
+			}
+		}
+		if (k == n) {
+			return a;
+		}
+
+		if (p == convert_policy::error) {
+			for (int i = 0; i < n; ++i) {
+				if (xs[i].xltype != xltypeNum) {
+					detail::convert_error("to_fp", i, c);
+				}
+			}
+		}
+		else if (p == convert_policy::skip) {
+			for (int i = 0, j = 0; i < n; ++i) {
+				if (xs[i].xltype == xltypeNum) {
+					pa[j++] = xs[i].val.num;
+				}
+			}
+			r == 1 ? a.resize(1, k) : a.resize(k, 1);
+		}
+		else {
+			constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+			for (int i = 0; i < n; ++i) {
+				if (xs[i].xltype != xltypeNum) {
+					pa[i] = nan;
+				}
+			}
+		}
+
+		return a;
+	}
+	inline FPX to_fp(const XLOPER12& x, convert_policy p = convert_policy::nan)
+	{
+		FPX a;
+		to_fp(x, a, p);
+
+		return a;
+	}
+
+	// Convert a to a Multi of numbers in o reusing its memory.
+	inline OPER& to_oper(const _FP12& a, OPER& o, convert_policy p = convert_policy::nan)
+	{
+		const int n = size(a);
+		if (p == convert_policy::error) {
+			for (int i = 0; i < n; ++i) {
+				if (a.array[i] != a.array[i]) {
+					detail::convert_error("to_oper", i, a.columns);
+				}
+			}
+		}
+
+		if (isMulti(o)) {
+			o.resize(a.rows, a.columns);
+		}
+		else {
+			o = OPER(a.rows, a.columns);
+		}
+		XLOPER12* os = o.val.array.lparray;
+		const XLOPER12 none = p == convert_policy::skip ? Nil : ErrNum;
+		for (int i = 0; i < n; ++i) {
+			// Elements left over from earlier values may own memory.
+			if (isAlloc(os[i])) {
+				static_cast<OPER&>(os[i]) = Nil;
+			}
+			const double x = a.array[i];
+			if (x == x) {
+				os[i].xltype = xltypeNum;
+				os[i].val.num = x;
+			}
+			else {
+				os[i] = none;
+			}
+		}
+
+		return o;
+	}
+	inline OPER to_oper(const _FP12& a, convert_policy p = convert_policy::nan)
+	{
+		OPER o;
+		to_oper(a, o, p);
+
+		return o;
+	}
+
+} // namespace xll
@@ -1,6 +1,7 @@
 // fpx.h - Excel FP12 data type.
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
+#include <stddef.h>
 
 #pragma warning(push)
 struct fpx {
@@ -22,10 +23,48 @@ inline int fpx_size(struct fpx* fpx)
 	return fpx->rows * fpx->columns;
 }
 
+// Alignment of array in memory allocated by fpx_malloc.
+#define FPX_ALIGN 64
+
+// Allocators must return FPX_ALIGN aligned memory or null.
+// Free is called with the same number of bytes as alloc.
+struct fpx_allocator {
+	void* (*alloc)(void* ctx, size_t bytes);
+	void (*free)(void* ctx, void* p, size_t bytes);
+	void* ctx;
+};
+// Default heap allocator.
+extern const struct fpx_allocator fpx_allocator_aligned;
+// Large pages when available for blocks of at least 1MB.
+extern const struct fpx_allocator fpx_allocator_pages;
+
+// Bump allocator over a buffer that must outlive every block allocated from it.
+// Only the most recent block is freed. Reset to reuse the whole buffer.
+struct fpx_arena {
+	char* base;
+	size_t size;
+	size_t used;
+	struct fpx_allocator allocator;
+};
+void fpx_arena_init(struct fpx_arena* a, void* buf, size_t size);
+void fpx_arena_reset(struct fpx_arena* a);
+
+// Allocator used by fpx_malloc on this thread. Null restores fpx_allocator_aligned.
+// Blocks are always freed and grown by the allocator that made them.
+const struct fpx_allocator* fpx_get_allocator(void);
+// Return the previous allocator.
+const struct fpx_allocator* fpx_set_allocator(const struct fpx_allocator* a);
+
 // Row-major order
 extern int fpx_index(struct fpx* fpx, int i, int j);
+// Memory allocated by fpx_malloc has a capacity that can exceed rows*columns.
+// If the allocator has no memory the default heap is used.
 struct fpx* fpx_malloc(int r, int c);
 struct fpx* fpx_realloc(struct fpx* fpx, int r, int c);
+int fpx_capacity(struct fpx* fpx);
+// Return null if n doubles cannot be allocated.
+struct fpx* fpx_reserve(struct fpx* fpx, int n);
+struct fpx* fpx_shrink_to_fit(struct fpx* fpx);
 void fpx_free(struct fpx*);
 // in-place transpose
 struct fpx* fpx_transpose(struct fpx* fpx);
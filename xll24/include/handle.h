@@ -1,16 +1,27 @@
 // handle.h - handles to C++ objects
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 // A handle<T> acts much like a std::unique_ptr<T> but is owned by the cell it is created in.
-// The 64-bits of the pointer are cast to a double and returned to Excel as a funny looking number.
-// In Windows the first 16 bits of a pointer are always 0 so the double is an exact integer.
+// Handles returned to Excel pack a type tag, generation, and slot index in an exact integer.
+// Looking one up is a bounds check and an array load, and handles to erased objects are stale.
+// Raw pointers can still be cast to handles with to_handle. In Windows the first 16 bits of
+// a pointer are always 0 so the double is an exact integer less than 2^48.
+// Lookups take no locks so functions using handles can be registered ThreadSafe().
 #pragma once
+#include <atomic>
+#include <bit>
 #include <limits>
-#include <map>
 #include <memory>
-#include <set>
+#include <mutex>
+#include <shared_mutex>
 #include <typeinfo>
+#include <unordered_map>
 #include <utility>
+#include <vector>
+#include "concurrent_pointer_map.h"
 #include "excel.h"
+#include "pointer_map.h"
+#include "slab.h"
+#include "snapshot.h"
 
 // handle data type
 using HANDLEX = double;
@@ -49,7 +60,7 @@ namespace xll {
 	}
 
 	// keep track of handles returned to Excel
-	inline std::set<void*> safe_pointers;
+	inline concurrent_pointer_set safe_pointers;
 
 	template<class T>
 	inline HANDLEX safe_handle(T* p)
@@ -76,31 +87,146 @@ namespace xll {
 	}
 
 	// typeid<T>.name() given pointer
-	inline std::map<void*, const char*> handle_typename;
+	inline concurrent_pointer_map<const char*> handle_typename;
 
-	// compare underlying raw pointers
-	template<class T>
-	struct unique_ptrcmp {
-		using is_transparent = void;
+	// Type tag, generation, and slot index of a handle.
+	// Bit 52 is set so slot handles never equal a pointer handle from to_handle.
+	struct slot_handle {
+		static constexpr int slot_bits = 28;
+		static constexpr int generation_bits = 16;
+		static constexpr int tag_bits = 8;
+
+		unsigned tag;
+		unsigned generation;
+		uint32_t slot;
 
-		template<class T>
-		bool operator()(const std::unique_ptr<T>& a, const T* b) const
+		static constexpr bool is(HANDLEX h) noexcept
 		{
-			return a.get() < b;
+			return h >= 0x1p52 && h < 0x1p53 && static_cast<HANDLEX>(static_cast<uint64_t>(h)) == h;
 		}
+		static constexpr slot_handle decode(HANDLEX h) noexcept
+		{
+			const uint64_t u = static_cast<uint64_t>(h);
 
-		template<class T>
-		bool operator()(const T* a, const std::unique_ptr<T>& b) const
+			return {
+				static_cast<unsigned>(u >> (slot_bits + generation_bits)) & ((1u << tag_bits) - 1),
+				static_cast<unsigned>(u >> slot_bits) & ((1u << generation_bits) - 1),
+				static_cast<uint32_t>(u) & ((1u << slot_bits) - 1),
+			};
+		}
+		constexpr HANDLEX encode() const noexcept
 		{
-			return a < b.get();
+			return static_cast<HANDLEX>((1ull << 52) | (static_cast<uint64_t>(tag) << (slot_bits + generation_bits))
+				| (static_cast<uint64_t>(generation) << slot_bits) | slot);
 		}
+	};
+	static_assert(slot_handle::slot_bits + slot_handle::generation_bits + slot_handle::tag_bits == 52);
+#ifdef _DEBUG
+	static_assert(slot_handle::is(slot_handle{ 255, 0xFFFF, (1u << 28) - 1 }.encode()));
+	static_assert(slot_handle::decode(slot_handle{ 1, 2, 3 }.encode()).tag == 1);
+	static_assert(slot_handle::decode(slot_handle{ 1, 2, 3 }.encode()).generation == 2);
+	static_assert(slot_handle::decode(slot_handle{ 1, 2, 3 }.encode()).slot == 3);
+	static_assert(!slot_handle::is(0x1p48 - 16));
+#endif // _DEBUG
+
+	namespace detail {
+		inline std::atomic<unsigned> handle_tags = 0;
+		// Snapshot key of the object of a live slot handle indexed by tag. Set when a type creates its first handle.
+		inline std::atomic<bool (*)(slot_handle, uint64_t&)> handle_keys[1u << slot_handle::tag_bits] = {};
+
+		// Sequential ids of calling cells so different cells never share one.
+		class callers {
+			// Type of the caller and the sheet and first area of a reference.
+			struct cell {
+				uint32_t type;
+				uint64_t sheet;
+				int32_t rwFirst, rwLast, colFirst, colLast;
+
+				bool operator==(const cell&) const = default;
+			};
+			struct cell_hash {
+				size_t operator()(const cell& c) const noexcept
+				{
+					size_t h = hash_combine(hash_mix(c.type), c.sheet);
+					h = hash_combine(h, (static_cast<uint64_t>(c.rwFirst) << 32) | static_cast<uint32_t>(c.rwLast));
+
+					return hash_combine(h, (static_cast<uint64_t>(c.colFirst) << 32) | static_cast<uint32_t>(c.colLast));
+				}
+			};
+			std::shared_mutex m;
+			std::unordered_map<cell, uint64_t, cell_hash> ids;
+
+			static cell key(const XLOPER12& x) noexcept
+			{
+				cell c{ static_cast<uint32_t>(type(x)), 0, 0, 0, 0, 0 };
+				const XLREF12* r = nullptr;
+				if (type(x) == xltypeSRef) {
+					r = &x.val.sref.ref;
+				}
+				else if (type(x) == xltypeRef && x.val.mref.lpmref && x.val.mref.lpmref->count) {
+					c.sheet = x.val.mref.idSheet;
+					r = x.val.mref.lpmref->reftbl;
+				}
+				if (r) {
+					c.rwFirst = r->rwFirst;
+					c.rwLast = r->rwLast;
+					c.colFirst = r->colFirst;
+					c.colLast = r->colLast;
+				}
+
+				return c;
+			}
+		public:
+			// Nonzero id of the calling cell. Equal cells have equal ids.
+			uint64_t id(const XLOPER12& x)
+			{
+				if (const uint64_t i = find(x)) {
+					return i;
+				}
+				std::unique_lock lock(m);
+
+				return ids.try_emplace(key(x), ids.size() + 1).first->second;
+			}
+			// Id of a cell that was given one or 0.
+			uint64_t find(const XLOPER12& x)
+			{
+				std::shared_lock lock(m);
+				const auto i = ids.find(key(x));
 
-		template<class T>
-		bool operator()(const std::unique_ptr<T>& a, const std::unique_ptr<T>& b) const
+				return i == ids.end() ? 0 : i->second;
+			}
+		};
+		inline callers& caller_ids()
 		{
-			return a.get() < b.get();
+			// Never destroyed so handles erased at exit can still compare callers.
+			static auto* ids = new callers;
+
+			return *ids;
 		}
-	};
+	}
+	// Tag distinguishing handles of different types.
+	template<class T>
+	inline unsigned handle_tag()
+	{
+		static const unsigned tag = []() {
+			const unsigned tag = detail::handle_tags.fetch_add(1);
+			ensure(tag < (1u << slot_handle::tag_bits) || !"handle_tag: too many handle types");
+			return tag;
+		}();
+
+		return tag;
+	}
+
+	inline bool snapshot_handle_key(double x, uint64_t& key) noexcept
+	{
+		if (!slot_handle::is(x)) {
+			return false;
+		}
+		const slot_handle s = slot_handle::decode(x);
+		const auto f = detail::handle_keys[s.tag].load(std::memory_order_acquire);
+
+		return f && f(s, key);
+	}
 
 	/// <summary>
 	/// Collection of handles parameterized by type.
@@ -115,90 +241,583 @@ namespace xll {
 	/// 
 	/// Use <c>handle<T> h_(h)</c> to lookup <c>h</c> returned by <c>get()</c>.
 	/// Functions that use handles do not need to be uncalced.
-	/// Unknown handles return null pointers.
-	/// This can be circumvented by using <c>handle<T> h_(h, false)</c>
-	/// to prevent the lookup.
+	/// Unknown and stale handles return null pointers.
+	/// Pointer handles from <c>to_handle(h.ptr())</c> are also found.
+	/// Use <c>handle<T> h_(h, false)</c> to convert unknown pointer handles without the check.
+	/// Lookups from many calculation threads are wait-free.
+	/// Derive T from <c>slab_allocated<T></c> so recalculating cells reuse memory.
+	/// 
+	/// Use <c>handle<T> h(snapshot_key(args...), [&]() { return new T(args...); })</c>
+	/// to save the object when the add-in closes and read it back instead of calling
+	/// the constructor when the add-in opens. Specialize <c>serialize<T></c> to use this.
+	/// Handle arguments of <c>snapshot_key</c> use the key of their object.
 	/// </summary>
 	template<class T>
 	class handle {
-		// all active pointers of type T*
-		inline static std::set<std::unique_ptr<T>, unique_ptrcmp<T>> ps;
-		// caller of handle
-		inline static std::map<T*, OPER> caller;
+		struct slot {
+			std::atomic<uint64_t> word = 0;   // generation << 48 | pointer
+			std::atomic<uint64_t> caller = 0; // id of creating cell, 0 if temporary
+			std::atomic<uint64_t> key = 0;    // snapshot key, 0 if none
+		};
+		static constexpr uint64_t pointer_mask = (1ull << 48) - 1;
+		// Objects not yet read from the snapshot have offset << 1 | unread in place of a pointer.
+		static constexpr uint64_t unread = 1;
+
+		// Slots are stored in chunks that never move so readers take no locks.
+		// Chunk 0 has 1024 slots and chunk k > 0 has 1024 << (k - 1).
+		class registry {
+			static constexpr int chunk_bits = 10;
+			static constexpr int chunks = slot_handle::slot_bits - chunk_bits + 1;
+			// Erased slots are reused after this many others so stale handles stay stale.
+			static constexpr size_t reuse = 1024;
+
+			std::atomic<slot*> chunk[chunks] = {};
+			std::atomic<uint32_t> n = 0; // slots handed out
+			std::vector<uint32_t> free;  // erased slots, oldest at head
+			size_t head = 0;
+
+			static int chunk_index(uint32_t i) noexcept
+			{
+				return i < (1u << chunk_bits) ? 0 : std::bit_width(i >> chunk_bits);
+			}
+			static uint32_t chunk_begin(int k) noexcept
+			{
+				return k ? (1u << (chunk_bits + k - 1)) : 0;
+			}
+			static uint32_t chunk_size(int k) noexcept
+			{
+				return k ? chunk_begin(k) : (1u << chunk_bits);
+			}
+			slot& at(uint32_t i) const noexcept
+			{
+				const int k = chunk_index(i);
+
+				return chunk[k].load(std::memory_order_acquire)[i - chunk_begin(k)];
+			}
+			// Index of an unused slot. Called with m held.
+			uint32_t acquire()
+			{
+				if (free.size() - head > reuse) {
+					const uint32_t i = free[head++];
+					if (2 * head > free.size()) {
+						free.erase(free.begin(), free.begin() + head);
+						head = 0;
+					}
+
+					return i;
+				}
+
+				const uint32_t i = n.load(std::memory_order_relaxed);
+				ensure(i < (1u << slot_handle::slot_bits) || !"handle: too many handles");
+				const int k = chunk_index(i);
+				if (!chunk[k].load(std::memory_order_relaxed)) {
+					chunk[k].store(new slot[chunk_size(k)], std::memory_order_release);
+				}
+				n.store(i + 1, std::memory_order_release);
+
+				return i;
+			}
+		public:
+			std::mutex m; // serializes creating and erasing handles
+			concurrent_pointer_map<uint32_t> index; // pointer to slot
+
+			constexpr registry() noexcept = default;
+			registry(const registry&) = delete;
+			registry& operator=(const registry&) = delete;
+			// Objects still in cells are deleted when the xll is unloaded.
+			~registry()
+			{
+				for (uint32_t i = 0; i < n; ++i) {
+					const uint64_t w = at(i).word.exchange(0);
+					if (!(w & unread)) {
+						delete reinterpret_cast<T*>(w & pointer_mask);
+					}
+				}
+				for (auto& c : chunk) {
+					delete[] c.load();
+				}
+			}
+
+			// Slot handle of p in a new slot. Null p reads the snapshot entry at off when first used.
+			// Called with m held.
+			slot_handle insert(T* p, uint64_t caller, uint64_t key = 0, uint64_t off = 0)
+			{
+				const uint32_t i = acquire();
+				slot& s = at(i);
+				const unsigned g = static_cast<unsigned>(s.word.load(std::memory_order_relaxed) >> 48);
+				s.caller.store(caller, std::memory_order_relaxed);
+				s.key.store(key, std::memory_order_relaxed);
+				const uint64_t w = p ? reinterpret_cast<uintptr_t>(p) : (off << 1) | unread;
+				s.word.store((static_cast<uint64_t>(g) << 48) | w, std::memory_order_release);
+				if (p) {
+					index.insert(p, i);
+				}
+
+				return { handle_tag<T>(), g, i };
+			}
+			// Stale handles to slot i. Called with m held.
+			// Slots are retired at the last generation so generations never wrap.
+			void erase(uint32_t i)
+			{
+				slot& s = at(i);
+				const uint64_t g = (s.word.load(std::memory_order_relaxed) >> 48) + 1;
+				s.word.store(g << 48, std::memory_order_release);
+				s.caller.store(0, std::memory_order_relaxed);
+				s.key.store(0, std::memory_order_relaxed);
+				if (g < (1u << slot_handle::generation_bits) - 1) {
+					free.push_back(i);
+				}
+			}
+			// Stale handles to p's slot. Called with m held.
+			bool erase(T* p)
+			{
+				uint32_t i;
+				if (!index.find(p, i)) {
+					return false;
+				}
+				index.erase(p);
+				erase(i);
+
+				return true;
+			}
+			// Stale h and set p to its object. Objects not read from the snapshot are null.
+			// Called with m held.
+			bool erase(slot_handle h, T*& p)
+			{
+				if (h.tag != handle_tag<T>() || h.slot >= n.load(std::memory_order_relaxed)) {
+					return false;
+				}
+				const uint64_t w = at(h.slot).word.load(std::memory_order_relaxed);
+				if ((w >> 48) != h.generation || !(w & pointer_mask)) {
+					return false;
+				}
+				p = (w & unread) ? nullptr : reinterpret_cast<T*>(w & pointer_mask);
+				if (p) {
+					index.erase(p);
+				}
+				erase(h.slot);
+
+				return true;
+			}
+			// Mark p as temporary. Called with m held.
+			void temporary(T* p)
+			{
+				uint32_t i;
+				if (index.find(p, i)) {
+					at(i).caller.store(0, std::memory_order_release);
+				}
+			}
+
+			// Read the object of slot i from the snapshot. Returns the new word of the slot.
+			// Slots that cannot be read are erased so they are not read again.
+			uint64_t restore(uint32_t i, uint64_t w) noexcept
+			{
+				if constexpr (serializable<T>) {
+					// Reading can create and erase handles so do not hold m.
+					std::unique_ptr<T> p;
+					try {
+						p.reset(snapshots()->read<T>((w & pointer_mask) >> 1));
+					}
+					catch (const std::exception&) {
+					}
+					// Unpublished p is deleted after unlocking.
+					std::lock_guard lock(m);
+					slot& s = at(i);
+					const uint64_t w_ = s.word.load(std::memory_order_relaxed);
+					// Another thread read or erased it.
+					if (w_ != w) {
+						return w_;
+					}
+					if (!p) {
+						erase(i);
+
+						return s.word.load(std::memory_order_relaxed);
+					}
+					index.insert(p.get(), i);
+					handle_typename.insert(p.get(), typeid(*p).name());
+					w = (w & ~pointer_mask) | reinterpret_cast<uintptr_t>(p.release());
+					s.word.store(w, std::memory_order_release);
+				}
+
+				return w;
+			}
+
+			// Pointer in the slot of h or nullptr if h is stale.
+			// Wait-free except when the object is first read from the snapshot.
+			T* find(slot_handle h, uint64_t* caller = nullptr) noexcept
+			{
+				if (h.tag != handle_tag<T>() || h.slot >= n.load(std::memory_order_acquire)) {
+					return nullptr;
+				}
+				const slot& s = at(h.slot);
+				uint64_t w = s.word.load(std::memory_order_acquire);
+				if ((w >> 48) != h.generation) {
+					return nullptr;
+				}
+				if (w & unread) {
+					w = restore(h.slot, w);
+					if ((w >> 48) != h.generation || (w & unread)) {
+						return nullptr;
+					}
+				}
+				if (caller) {
+					*caller = s.caller.load(std::memory_order_acquire);
+					// The slot was not erased and reused while reading.
+					if (s.word.load(std::memory_order_relaxed) != w) {
+						return nullptr;
+					}
+				}
+
+				return reinterpret_cast<T*>(w & pointer_mask);
+			}
+			// Set k to the snapshot key of the object of h, 0 if none. False if h is stale.
+			bool key(slot_handle h, uint64_t& k) const noexcept
+			{
+				if (h.tag != handle_tag<T>() || h.slot >= n.load(std::memory_order_acquire)) {
+					return false;
+				}
+				const slot& s = at(h.slot);
+				const uint64_t w = s.word.load(std::memory_order_acquire);
+				if ((w >> 48) != h.generation || !(w & pointer_mask)) {
+					return false;
+				}
+				k = s.key.load(std::memory_order_acquire);
+
+				// The slot was not erased and reused while reading.
+				return s.word.load(std::memory_order_relaxed) == w;
+			}
+			// Slot handle of p.
+			bool find(const T* p, slot_handle& h) const noexcept
+			{
+				uint32_t i;
+				if (!index.find(p, i) || i >= n.load(std::memory_order_acquire)) {
+					return false;
+				}
+				const uint64_t w = at(i).word.load(std::memory_order_acquire);
+				if ((w & pointer_mask) != reinterpret_cast<uintptr_t>(p)) {
+					return false;
+				}
+				h = { handle_tag<T>(), static_cast<unsigned>(w >> 48), i };
+
+				return true;
+			}
+
+			// Add objects created with a key to the next snapshot.
+			void save(snapshot::out& o)
+			{
+				if constexpr (serializable<T>) {
+					std::lock_guard lock(m);
+					for (uint32_t i = 0; i < n.load(std::memory_order_relaxed); ++i) {
+						const slot& s = at(i);
+						const uint64_t w = s.word.load(std::memory_order_relaxed);
+						const uint64_t key = s.key.load(std::memory_order_relaxed);
+						// Temporaries are not kept by a cell.
+						if (!key || !(w & pointer_mask) || !s.caller.load(std::memory_order_relaxed)) {
+							continue;
+						}
+						if (w & unread) {
+							// Copy the entry without reading the object.
+							const std::string_view e = snapshots()->data((w & pointer_mask) >> 1);
+							if (e.data()) {
+								o.add(snapshot_type<T>(), key, serialize_version<T>(), [e](snapshot_writer& w_) {
+									w_.put(e.data(), e.size());
+								});
+							}
+						}
+						else {
+							const T* p = reinterpret_cast<const T*>(w & pointer_mask);
+							o.add(snapshot_type<T>(), key, serialize_version<T>(), [p](snapshot_writer& w_) {
+								serialize<T>::write(w_, *p);
+							});
+						}
+					}
+				}
+			}
+		};
+		inline static registry r;
+
+		// Nonzero id of the calling cell. Different cells have different ids.
+		static uint64_t caller_id(const XLOPER12& cell)
+		{
+			return detail::caller_ids().id(cell);
+		}
+		// Id of the calling cell if it created a handle or 0.
+		static uint64_t find_caller_id(const XLOPER12& cell)
+		{
+			return detail::caller_ids().find(cell);
+		}
+
+		// Handles recently created on this thread and the id of their caller.
+		// A handle created in an argument is looked up by the enclosing function
+		// before many others are created so only those lookups call Excel.
+		// If a cell creates more handles than fit, lookups of handles it created
+		// compare callers like the ring was not there.
+		class recent {
+			static constexpr unsigned size = 8;
+			HANDLEX h[size] = {};
+			uint64_t id[size] = {};
+			unsigned next = 0;
+			uint64_t lost = 0; // caller that pushed out its own handles
+
+			static recent& local() noexcept
+			{
+				static thread_local recent r;
+
+				return r;
+			}
+		public:
+			static void push(HANDLEX h, uint64_t id) noexcept
+			{
+				recent& r = local();
+				const unsigned i = r.next++ % size;
+				// Excel evaluates one cell at a time on a thread so a new caller ends the last one.
+				if (r.h[i] && r.id[i] == id) {
+					r.lost = id;
+				}
+				else if (r.lost != id) {
+					r.lost = 0;
+				}
+				r.h[i] = h;
+				r.id[i] = id;
+			}
+			// Caller whose handles might have been pushed out, or 0.
+			static uint64_t evicted() noexcept
+			{
+				return local().lost;
+			}
+			// Remove h and return the id of its caller.
+			static bool pop(HANDLEX h, uint64_t& id) noexcept
+			{
+				recent& r = local();
+				for (unsigned i = 0; i < size; ++i) {
+					if (r.h[i] == h) {
+						r.h[i] = 0;
+						id = r.id[i];
+
+						return true;
+					}
+				}
+
+				return false;
+			}
+		};
+
+		// Pointer for a slot or pointer handle and the id of its caller. Sets s to the slot handle.
+		static T* pointer(HANDLEX h, slot_handle& s, uint64_t* caller = nullptr) noexcept
+		{
+			if (!slot_handle::is(h)) {
+				// Pointer handles are found through their slot.
+				if (!r.find(to_pointer<T>(h), s)) {
+					return nullptr;
+				}
+			}
+			else {
+				s = slot_handle::decode(h);
+			}
+
+			return r.find(s, caller);
+		}
+		static T* pointer(HANDLEX h, uint64_t* caller = nullptr) noexcept
+		{
+			slot_handle s;
+
+			return pointer(h, s, caller);
+		}
 
 		static void erase(T* p) noexcept
 		{
-			if (p != nullptr) {
-				auto p_ = ps.find(p);
-				if (p_ != ps.end()) {
-					ps.erase(p_);
+			// ~T can erase other handles so delete after unlocking.
+			std::unique_ptr<T> p_;
+			{
+				std::lock_guard lock(r.m);
+				if (r.erase(p)) {
+					handle_typename.erase(p);
+					p_.reset(p);
 				}
-				auto ph = handle_typename.find(p);
-				if (ph != handle_typename.end()) {
-					handle_typename.erase(ph);
+			}
+		}
+		// Erase without reading objects that are still in the snapshot.
+		static void erase(slot_handle s) noexcept
+		{
+			std::unique_ptr<T> p_;
+			{
+				std::lock_guard lock(r.m);
+				T* p = nullptr;
+				if (r.erase(s, p) && p) {
+					handle_typename.erase(p);
+					p_.reset(p);
 				}
 			}
 		}
+		static void save(snapshot::out& o)
+		{
+			r.save(o);
+		}
+		static bool key(slot_handle s, uint64_t& k) noexcept
+		{
+			return r.key(s, k);
+		}
+		// Snapshot holding objects of T.
+		static snapshot*& snapshots() noexcept
+		{
+			static snapshot* s = &snapshot::instance();
+
+			return s;
+		}
 
-		// Convert handle in caller to pointer.
-		static T* coerce(const OPER& cell)
+		// Calling cell in memory owned by Excel so creating a handle does not copy a reference.
+		class calling_cell {
+			XLOPER12 x = { .xltype = xltypeNil };
+		public:
+			calling_cell()
+			{
+				ensure_ret(::Excel12v(xlfCaller, &x, 0, nullptr));
+			}
+			calling_cell(const calling_cell&) = delete;
+			calling_cell& operator=(const calling_cell&) = delete;
+			~calling_cell()
+			{
+				if (isAlloc(x)) {
+					::Excel12(xlFree, 0, 1, &x);
+				}
+			}
+			operator const XLOPER12&() const noexcept
+			{
+				return x;
+			}
+		};
+
+		// Slot of the handle in caller.
+		static bool coerce(const XLOPER12& cell, slot_handle& s)
 		{
 			const OPER o = Excel(xlCoerce, cell);
+			if (o.xltype != xltypeNum) {
+				return false;
+			}
+			if (slot_handle::is(o.val.num)) {
+				s = slot_handle::decode(o.val.num);
 
-			return o.xltype == xltypeNum ? to_pointer<T>(o.val.num) : nullptr;
+				return true;
+			}
+
+			return r.find(to_pointer<T>(o.val.num), s);
 		}
 
-		// underlying pointer
-		T* p;
+		// Add p, or the snapshot entry at off if p is null, to the collection.
+		void create(uint64_t key, uint64_t off)
+		{
+			// snapshot_key of inputs with handles of T
+			static const bool keys = (detail::handle_keys[handle_tag<T>()].store(&handle::key, std::memory_order_release), true);
+			(void)keys;
+
+			const calling_cell cell;
+			slot_handle s;
+			const bool old = coerce(cell, s);
+			const uint64_t id = caller_id(cell);
+			{
+				std::lock_guard lock(r.m);
+				h = r.insert(p, id, key, off).encode();
+				// returned by HANDLE.TYPENAME(handle)
+				if (p) {
+					handle_typename.insert(p, typeid(*p).name());
+				}
+			}
+			recent::push(h, id);
+
+			// delete and erase if calling cell has a valid handle to T
+			if (old) {
+				erase(s);
+			}
+		}
+
+		// underlying pointer, null until used if the object is in the snapshot
+		mutable T* p;
+		// handle returned by get()
+		HANDLEX h;
+		// erase p when this lookup ends
+		bool temp = false;
+		// p is read from the snapshot when first used
+		bool lazy = false;
 	public:
 		/// <summary>
 		/// Add a handle to the collection.
 		/// </summary>
 		explicit handle(T* p) noexcept
-			: p{ p }
+			: p{ p }, h{ INVALID_HANDLEX }
 		{
-			// store unique_ptr
-			ps.emplace(std::unique_ptr<T>(p));
-
-			// delete and erase if calling cell has a valid pointer to T
-			erase(coerce(caller[p] = Excel(xlfCaller)));
+			create(0, 0);
+		}
+		/// <summary>
+		/// Add a handle that is saved in the snapshot when the add-in closes.
+		/// If the snapshot has an object for key then make is not called.
+		/// </summary>
+		template<class F>
+			requires serializable<T> && std::is_invocable_r_v<T*, F>
+		handle(const snapshot_key& key, F&& make)
+			: p{ nullptr }, h{ INVALID_HANDLEX }
+		{
+			static const bool saved = (snapshots()->add_saver(&save), true);
+			(void)saved;
 
-			// returned by HANDLE.TYPENAME(handle)
-			handle_typename[p] = typeid(*p).name();
+			// Inputs with handles that have no key give no key.
+			const uint64_t off = key.value() ? snapshots()->find(snapshot_type<T>(), key.value(), serialize_version<T>()) : 0;
+			if (off) {
+				lazy = true;
+			}
+			else {
+				p = std::forward<F>(make)();
+			}
+			create(key.value(), off);
+		}
+		/// <summary>
+		/// Use s in place of <c>snapshot::instance()</c> for objects of T.
+		/// Call before creating handles with a key, e.g. to test without the add-in's snapshot.
+		/// </summary>
+		static void use(snapshot& s)
+		{
+			snapshots() = &s;
+			s.add_saver(&save);
 		}
 		/// <summary>
 		/// Lookup an existing handle.
+		/// Only handles just created on this thread call back into Excel.
 		/// </summary>
 		handle(HANDLEX h, bool check = true) noexcept
-			: p(to_pointer<T>(h))
+			: p(nullptr), h(h)
 		{
-			if (check && p) {
-				if (!ps.contains(p) && !safe_pointers.contains(p)) {
-					// unknown handle
-					p = nullptr;
+			slot_handle s;
+			uint64_t caller = 0;
+			if ((p = pointer(h, s, &caller))) {
+				this->h = s.encode();
+				// handle was created by a function argument
+				uint64_t id;
+				if (recent::pop(this->h, id)
+					? id == find_caller_id(calling_cell{})
+					: caller && caller == recent::evicted() && caller == find_caller_id(calling_cell{})) {
+					is_temporary(p);
+					temp = true;
 				}
 			}
-			// handle was created by a function argument
-			if (p && !safe_pointers.contains(p) && caller[p] == Excel(xlfCaller)) {
-				is_temporary(p);
+			else if (!slot_handle::is(h) && (!check || safe_pointers.contains(to_pointer<T>(h)))) {
+				p = to_pointer<T>(h);
 			}
 		}
 		handle(const handle&) = delete;
 		handle& operator=(const handle&) = delete;
-		handle(handle&& h) noexcept
-			: p(h.p)
+		handle(handle&& h_) noexcept
+			: p(h_.p), h(h_.h), temp(std::exchange(h_.temp, false)), lazy(h_.lazy)
 		{ }
-		handle& operator=(handle&& h) noexcept
+		handle& operator=(handle&& h_) noexcept
 		{
-			if (p != h.p) {
-				swap(h);
+			if (this != &h_) {
+				swap(h_);
 			}
 
 			return *this;
 		}
 		~handle()
 		{
-			if (is_temporary()) {
+			if (temp) {
 				erase(p);
 			}
 		}
@@ -207,51 +826,62 @@ namespace xll {
 		void is_temporary(T* p_)
 		{
 			if (!safe_pointers.contains((void*)p_)) {
-				caller[p_] = ErrNA;
+				std::lock_guard lock(r.m);
+				r.temporary(p_);
 			}
 		}
 
 		[[nodiscard]] bool is_temporary() const
 		{
-			return (!safe_pointers.contains((void*)p)) && caller[p] == ErrNA;
+			uint64_t id;
+
+			return ptr() && pointer(h, &id) == p && id == 0;
 		}
 
-		void swap(handle& h) noexcept
+		void swap(handle& h_) noexcept
 		{
 			using std::swap;
 
-			// ps unchanged
-			swap(p, h.p);
+			// registry unchanged
+			swap(p, h_.p);
+			swap(h, h_.h);
+			swap(temp, h_.temp);
+			swap(lazy, h_.lazy);
 		}
 
+		// Objects in the snapshot are read to check they can be.
 		explicit operator bool() const
 		{
-			return p != nullptr;
+			return ptr() != nullptr;
 		}
 
 		// return value for Excel
 		[[nodiscard]] HANDLEX get() const
 		{
-			return to_handle(p);
+			return h;
 		}
 		// underlying pointer
 		[[nodiscard]] T* ptr() const
 		{
+			if (!p && lazy) {
+				p = pointer(h);
+			}
+
 			return p;
 		}
 
 		// act like a unique pointer
 		typename std::add_lvalue_reference_t<T> operator*() const
 		{
-			return *p;
+			return *ptr();
 		}
 		T* operator->()
 		{
-			return p;
+			return ptr();
 		}
 		const T* operator->() const
 		{
-			return p;
+			return ptr();
 		}
 
 		// downcast to U
@@ -259,7 +889,7 @@ namespace xll {
 			requires std::is_base_of_v<T, U>
 		U* as()
 		{
-			return dynamic_cast<U*>(p);
+			return dynamic_cast<U*>(ptr());
 		}
 
 		// encode/decode handles to strings
@@ -272,43 +902,35 @@ namespace xll {
 			{
 				return static_cast<XCHAR>(h <= 9 ? '0' + h : 'A' + h - 10);
 			}
+			// hex digits of a 53 bit handle
+			static constexpr unsigned digits = 14;
 			// "01..F" -> h
 			static HANDLEX decode_(LPWSTR pc)
 			{
-				union {
-					T* h;
-					uint8_t c[8];
-				} hc = { 0 };
-
-				for (unsigned i = 0; i < 6; ++i) {
-					hc.c[5 - i] = (c2h(pc[2 * i]) << 4) + c2h(pc[2 * i + 1]);
+				uint64_t u = 0;
+				for (unsigned i = 0; i < digits; ++i) {
+					u = (u << 4) | c2h(pc[i]);
 				}
 
-				return to_handle<T>(hc.h);
+				return static_cast<HANDLEX>(u);
 			}
 			// h -> "01..F"
 			static void encode_(HANDLEX h, XCHAR* pc)
 			{
-				union {
-					T* h;
-					uint8_t c[8];
-				} hc;
-				hc.h = to_pointer<T>(h);
-
-				for (unsigned i = 0; i < 6; ++i) {
-					pc[2 * i] = h2c(hc.c[5 - i] >> 4);
-					pc[2 * i + 1] = h2c(hc.c[5 - i] & 0x0F);
+				uint64_t u = static_cast<uint64_t>(h);
+				for (unsigned i = digits; i-- > 0; u >>= 4) {
+					pc[i] = h2c(u & 0x0F);
 				}
 			}
 
-			OPER H;  // "prefix0123456789ABCDEFsuffix"
+			OPER H;  // "prefix0123456789ABCDsuffix"
 			unsigned off; // size of prefix
 		public:
 			// e.g., codec c(OPER("\\MyClass["), OPER("]"));
 			codec(const char* prefix, const char* suffix)
 				: H(prefix), off(H.val.str[0])
 			{
-				H &= OPER("456789ABCDEF");
+				H &= OPER("0123456789ABCD");
 				H &= OPER(suffix);
 			}
 			// use 
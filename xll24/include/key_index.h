@@ -0,0 +1,87 @@
+// key_index.h - Hash index of keys in JSON like two row or two column OPER.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Built once so lookups are O(1) instead of a linear scan with compare.
+#pragma once
+#include <unordered_map>
+#include "oper.h"
+
+namespace xll {
+
+	class key_index {
+		OPER dict;
+		// Keys are shallow copies of elements of dict.
+		std::unordered_map<XLOPER12, int, hash_xloper, equal_xloper> index;
+
+		void build()
+		{
+			ensure((isMulti(dict) && (rows(dict) == 2 || columns(dict) == 2)) || !"key_index: must have two rows or two columns");
+
+			// Two rows are used when the shape is 2 x 2, like xll::lookup.
+			const bool byrow = rows(dict) == 2;
+			const int n = byrow ? columns(dict) : rows(dict);
+			index.reserve(n);
+			for (int i = 0; i < n; ++i) {
+				// First key wins, like a linear scan.
+				if (byrow) {
+					index.try_emplace(dict(0, i), columns(dict) + i);
+				}
+				else {
+					index.try_emplace(dict(i, 0), 2 * i + 1);
+				}
+			}
+		}
+	public:
+		key_index(const XLOPER12& x)
+			: dict(x)
+		{
+			build();
+		}
+		key_index(OPER&& x)
+			: dict(std::move(x))
+		{
+			build();
+		}
+		key_index(const key_index&) = delete;
+		key_index& operator=(const key_index&) = delete;
+		~key_index() = default;
+
+		int size() const
+		{
+			return static_cast<int>(index.size());
+		}
+		const OPER& dictionary() const
+		{
+			return dict;
+		}
+
+		// Index of value corresponding to key or -1 if not found.
+		int lookup(const XLOPER12& key) const
+		{
+			const auto i = index.find(key);
+
+			return i == index.end() ? -1 : i->second;
+		}
+		// Value corresponding to key or ErrValue if not found.
+		const XLOPER12& value(const XLOPER12& key) const
+		{
+			const int i = lookup(key);
+
+			return i == -1 ? ErrValue : dict[i];
+		}
+		// Values corresponding to every key with the shape of keys.
+		OPER values(const XLOPER12& keys) const
+		{
+			if (!isMulti(keys)) {
+				return OPER(value(keys));
+			}
+
+			OPER o(rows(keys), columns(keys));
+			for (int i = 0; i < xll::size(keys); ++i) {
+				o[i] = value(Multi(keys)[i]);
+			}
+
+			return o;
+		}
+	};
+
+} // namespace xll
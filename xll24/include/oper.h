@@ -4,8 +4,19 @@
 #ifdef _DEBUG
 #include <cassert>
 #endif // _DEBUG
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
 #include <initializer_list>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "concurrent_pointer_map.h"
+#include "pointer_map.h"
 #include "xloper.h"
 #include "utf8.h"
 
@@ -25,39 +36,178 @@ namespace xll {
 	}
 	static_assert(len("abc") == 3);
 
-	struct OPER;
-	// Keep track of nested handles.
-	struct handles {
-		static double handle(OPER* po)
+	// Header preceding memory allocated for OPER strings and arrays.
+	struct oper_header {
+		enum kind : unsigned short {
+			heap = 1, // freed by its owner
+			block,    // array owning an arena of nested strings and arrays
+			arena,    // freed with the enclosing block
+			interned, // reference counted by string_pool
+		};
+		enum flag : unsigned short {
+			nested = 1, // the array holds references to handles
+		};
+		unsigned short kind;
+		unsigned short flags;
+		unsigned capacity; // number of XCHAR or OPER allocated, or reference count
+	};
+	static_assert(sizeof(oper_header) % alignof(XLOPER12) == 0);
+
+	// Reference counted immutable strings with one buffer per distinct value.
+	// Chunks are never freed so pointers can be tested without a lock.
+	// Released buffers go on a free list by size and are reused last in, first out.
+	class string_pool {
+		static constexpr size_t chunk_bytes = 1 << 18;
+		static constexpr int max_chunks = 64;
+
+		std::atomic<std::byte*> chunk[max_chunks] = {};
+		std::atomic<int> chunks = 0;
+		std::byte* next = nullptr;
+		std::byte* last = nullptr;
+		std::mutex mutex;
+		std::unordered_map<std::wstring_view, XCHAR*> table;
+		std::unordered_map<size_t, std::vector<XCHAR*>> free;
+
+		static oper_header* header(XCHAR* p) noexcept
 		{
-			return static_cast<double>(reinterpret_cast<uintptr_t>(po));
+			return reinterpret_cast<oper_header*>(p) - 1;
 		}
-		static OPER* pointer(double h)
+		// Bytes used by a string of length len and its header.
+		static constexpr size_t bytes(XCHAR len) noexcept
 		{
-			return reinterpret_cast<OPER*>(static_cast<uintptr_t>(h));
+			constexpr size_t align = alignof(oper_header);
+
+			return (sizeof(oper_header) + (1 + static_cast<size_t>(len)) * sizeof(XCHAR) + align - 1) / align * align;
 		}
-		static std::map<double, OPER*>& map()
+		static std::atomic_ref<unsigned> refs(XCHAR* p) noexcept
 		{
-			static std::map<double, OPER*> map;
+			return std::atomic_ref<unsigned>(header(p)->capacity);
+		}
+		string_pool() = default;
+	public:
+		string_pool(const string_pool&) = delete;
+		string_pool& operator=(const string_pool&) = delete;
 
-			return map;
+		// Never destroyed so static OPERs can release strings at exit.
+		static string_pool& instance()
+		{
+			static string_pool* pool = new string_pool;
+
+			return *pool;
 		}
-		static double insert(OPER* po)
+
+		// Counted string with an added reference or nullptr if the pool is full.
+		XCHAR* intern(const XCHAR* str, XCHAR len)
 		{
-			map().insert({ handle(po), po});
+			std::lock_guard lock(mutex);
+
+			const auto i = table.find(std::wstring_view(str, len));
+			if (i != table.end()) {
+				addref(i->second);
+
+				return i->second;
+			}
 
-			return handle(po);
+			const size_t n = bytes(len);
+			std::byte* q = nullptr;
+			if (auto f = free.find(n); f != free.end() && !f->second.empty()) {
+				q = reinterpret_cast<std::byte*>(header(f->second.back()));
+				f->second.pop_back();
+			}
+			else if (static_cast<size_t>(last - next) < n) {
+				const int c = chunks.load(std::memory_order_relaxed);
+				if (n > chunk_bytes || c == max_chunks) {
+					return nullptr;
+				}
+				next = static_cast<std::byte*>(::operator new(chunk_bytes));
+				last = next + chunk_bytes;
+				chunk[c].store(next, std::memory_order_relaxed);
+				chunks.store(c + 1, std::memory_order_release);
+			}
+			if (!q) {
+				q = next;
+				next += n;
+			}
+
+			auto ph = reinterpret_cast<oper_header*>(q);
+			ph->kind = oper_header::interned;
+			ph->flags = 0;
+			ph->capacity = 1;
+			XCHAR* p = reinterpret_cast<XCHAR*>(ph + 1);
+			p[0] = len;
+			std::copy_n(str, len, p + 1);
+			table.emplace(std::wstring_view(p + 1, len), p);
+
+			return p;
+		}
+		// True if p points into pool memory.
+		bool contains(const void* p) const noexcept
+		{
+			const int n = chunks.load(std::memory_order_acquire);
+			for (int i = 0; i < n; ++i) {
+				const std::byte* b = chunk[i].load(std::memory_order_relaxed);
+				if (std::less_equal<const void*>{}(b, p) && std::less<const void*>{}(p, b + chunk_bytes)) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+		static void addref(XCHAR* p) noexcept
+		{
+			refs(p).fetch_add(1, std::memory_order_relaxed);
 		}
-		static OPER* find(double h)
+		// Drop unreferenced strings from the table and free their memory for reuse.
+		void release(XCHAR* p)
 		{
-			const auto i = map().find(h);
+			if (refs(p).fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				std::lock_guard lock(mutex);
+				if (refs(p).load() == 0) {
+					const auto i = table.find(std::wstring_view(p + 1, p[0]));
+					if (i != table.end() && i->second == p) {
+						table.erase(i);
+						free[bytes(p[0])].push_back(p);
+					}
+				}
+			}
+		}
+	};
 
-			return i == map().end() ? nullptr : i->second;
+	struct OPER;
+	// Nested OPERs replaced by numbers in compressed OPERs.
+	// The registry owns them and counts references. A compressed multi records the
+	// handles it holds, keyed by its elements, so only those are released when it is
+	// destroyed and copies of it hold their own references. Numbers are never looked up.
+	struct handles {
+		static double handle(OPER* po)
+		{
+			return static_cast<double>(reinterpret_cast<uintptr_t>(po));
 		}
-		static void erase(double h)
+		static OPER* pointer(double h)
 		{
-			map().erase(h);
+			// Only positive integers less than 2^53 can be pointers.
+			if (!(h > 0 && h < 0x1p53)) {
+				return nullptr;
+			}
+
+			return reinterpret_cast<OPER*>(static_cast<uintptr_t>(h));
 		}
+		// Take ownership of po. The caller holds one reference.
+		static double insert(OPER* po);
+		static OPER* find(double h);
+		// Drop a reference and delete the OPER when none are left.
+		static void erase(double h);
+
+		// Record that the multi with elements a holds a reference to h.
+		static void own(const void* a, double h);
+		// References held by the multi with elements a, or nullptr. Wait-free.
+		static const std::vector<double>* owned(const void* a) noexcept;
+		// Add references for the copy b of the multi with elements a. False if a holds none.
+		static bool share(const void* a, const void* b);
+		// The elements of a multi moved from a to b.
+		static void move(const void* a, const void* b);
+		// Release the references held by the multi with elements a.
+		static void release(const void* a);
 	};
 
 	struct OPER : public XLOPER12 {
@@ -66,7 +216,7 @@ namespace xll {
 			: XLOPER12{ Nil }
 		{ }
 
-		constexpr OPER(const XLOPER12& x)
+		OPER(const XLOPER12& x)
 			: XLOPER12{x}
 		{
 			if (isAlloc(x)) {
@@ -74,7 +224,7 @@ namespace xll {
 			}
 		}
 		
-		constexpr OPER(const OPER& o)
+		OPER(const OPER& o)
 			: OPER(static_cast<const XLOPER12&>(o))
 		{ }
 		
@@ -94,14 +244,24 @@ namespace xll {
 			return operator=(static_cast<const XLOPER12&>(o));
 		}
 		
-		OPER(OPER&& o) noexcept
+		// Arena memory lives as long as its block so it is copied, not moved.
+		// Copying can throw so moves are not noexcept.
+		OPER(OPER&& o)
 			: XLOPER12{ o }
 		{
-			o.xltype = xltypeNil;
+			if (isArena(o)) {
+				alloc(o);
+			}
+			else {
+				o.xltype = xltypeNil;
+			}
 		}
-		OPER& operator=(OPER&& o) noexcept
+		OPER& operator=(OPER&& o)
 		{
 			if (this != &o) {
+				if (isArena(o)) {
+					return operator=(static_cast<const XLOPER12&>(o));
+				}
 				dealloc();
 				xltype = std::exchange(o.xltype, xltypeNil);
 				val = o.val;
@@ -152,7 +312,7 @@ namespace xll {
 		}
 
 		// Str - Counted wide character string.
-		constexpr OPER(const XCHAR* str, XCHAR len)
+		OPER(const XCHAR* str, XCHAR len)
 		{
 			alloc(str, len);
 		}
@@ -163,14 +323,15 @@ namespace xll {
 		{ }
 		*/
 		// NULL terminated string
-		constexpr explicit OPER(const XCHAR* str)
+		explicit OPER(const XCHAR* str)
 			: OPER(str, str ? len(str) : 0)
 		{ }
-		// utf8::mbstowcs calls new wchar_t[].
+		// UTF-8 to null terminated counted wide character string.
 		explicit OPER(const char* str)
-			: XLOPER12{ .val = {.str = utf8::mbstowcs(str)}, .xltype = xltypeStr }
-		{ }
-		constexpr OPER(const std::wstring_view& str)
+		{
+			alloc(str);
+		}
+		OPER(const std::wstring_view& str)
 			: OPER(str.data(), static_cast<XCHAR>(str.size()))
 		{ }
 		OPER(const std::string_view& str)
@@ -268,7 +429,7 @@ namespace xll {
 		OPER safe_name() const
 		{
 			if (isStr(*this)) {
-				OPER safe(*this);
+				OPER safe(val.str + 1, val.str[0]); // not shared
 				for (int i = 1; i <= safe.val.str[0]; ++i) {
 					if (!iswalnum(safe.val.str[i])) {
 						safe.val.str[i] = L'_';
@@ -353,12 +514,12 @@ namespace xll {
 		{ }
 
 		// Multi
-		constexpr OPER(int r, int c, const XLOPER12* a = nullptr)
+		OPER(int r, int c, const XLOPER12* a = nullptr)
 		{
 			alloc(r, c, a);
 		}
 		// One row multi.
-		constexpr OPER(std::initializer_list<XLOPER12> a)
+		OPER(std::initializer_list<XLOPER12> a)
 			: OPER(1, static_cast<int>(a.size()), a.begin())
 		{ }
 
@@ -377,13 +538,29 @@ namespace xll {
 				return reshape(r, c);
 			}
 
-			OPER o(*this);
-			dealloc();
-			alloc(r, c, nullptr);
-			for (int i = 0; i < (std::min)(r * c, size(o)); ++i) {
-				operator[](i) = o[i];
+			if (size(*this) == 0 || r * c == 0) {
+				dealloc();
+				alloc(r, c, nullptr);
+
+				return *this;
 			}
 
+			enlist();
+			const int n = size(*this);
+			OPER* a = static_cast<OPER*>(Multi(*this));
+			if (r * c < n) {
+				for (int i = r * c; i < n; ++i) {
+					a[i].dealloc();
+				}
+			}
+			else {
+				expand(r * c);
+				a = static_cast<OPER*>(Multi(*this));
+				std::uninitialized_default_construct_n(a + n, r * c - n);
+			}
+			val.array.rows = r;
+			val.array.columns = c;
+
 			return *this;
 		}
 
@@ -469,8 +646,34 @@ namespace xll {
 			return *this;
 		}
 
+		// Number of elements a Multi can hold without reallocating.
+		int capacity() const noexcept
+		{
+			if (isHeap()) {
+				return static_cast<int>(header(*this)->capacity);
+			}
+
+			return size(*this);
+		}
+		// Reserve space for at least n elements. Empty OPERs are not changed.
+		OPER& reserve(int n)
+		{
+			if (size(*this) != 0) {
+				enlist();
+				if (n > capacity()) {
+					grow(n);
+				}
+			}
+
+			return *this;
+		}
+
+		// Amortized O(size(x)) when capacity is available.
 		OPER& vstack(const XLOPER12& x)
 		{
+			if (aliases(x)) {
+				return vstack(OPER(x));
+			}
 			if (size(x) == 0) {
 				return *this;
 			}
@@ -480,59 +683,131 @@ namespace xll {
 			if (columns(*this) != columns(x)) {
 				return operator=(ErrValue);
 			}
-			if (!isMulti(*this)) {
-				enlist();
-			}
 
-			int n = size(*this);
-			OPER o(rows(*this) + rows(x), columns(*this), nullptr);
-			for (int i = 0; i < n; ++i) {
-				o[i] = operator[](i);
-			}
-			if (!isMulti(*this)) {
-				o[n] = x;
+			const int n = size(*this);
+			expand(n + size(x));
+			OPER* a = static_cast<OPER*>(Multi(*this));
+			if (type(x) != xltypeMulti) {
+				new (a + n) OPER(x);
 			}
 			else {
 				for (int i = 0; i < size(x); ++i) {
-					o[size(*this) + i] = x.val.array.lparray[i];
+					new (a + n + i) OPER(Multi(x)[i]);
 				}
+				share(x);
 			}
-			std::swap(*this, o);
+			val.array.rows += rows(x);
 
 			return *this;
 		}
+		// Move elements of x instead of copying them.
+		OPER& vstack(OPER&& x)
+		{
+			if (!x.isHeap() || aliases(x) || size(*this) == 0 || columns(*this) != columns(x)) {
+				return vstack(static_cast<const XLOPER12&>(x));
+			}
+
+			const int n = size(*this);
+			expand(n + size(x));
+			std::memcpy(static_cast<void*>(Multi(*this) + n), Multi(x), size(x) * sizeof(OPER));
+			val.array.rows += rows(x);
+			take(x);
+			deallocate(x.val.array.lparray);
+			x.xltype = xltypeNil;
+
+			return *this;
+		}
+		// Move elements to transposed positions. No Excel callback.
 		OPER& transpose()
 		{
-			if (isMulti(*this)) {
-				XLOPER12 o;
-				int ret = ::Excel12(xlfTranspose, &o, 1, this);
-				if (ret == xlretSuccess) {
-					operator=(o);
-					::Excel12(xlFree, 0, 1, &o);
+			if (type(*this) != xltypeMulti) {
+				return *this;
+			}
+
+			const int r = rows(*this);
+			const int c = columns(*this);
+			if (r != 1 && c != 1) {
+				// Elements are relocated bitwise so strings are never copied.
+				XLOPER12* a = Multi(*this);
+				auto b = std::make_unique_for_overwrite<XLOPER12[]>(size(*this));
+				std::memcpy(b.get(), a, size(*this) * sizeof(XLOPER12));
+				// Tiles of transpose_block x transpose_block stay in cache.
+				for (int i0 = 0; i0 < r; i0 += transpose_block) {
+					const int i1 = (std::min)(i0 + transpose_block, r);
+					for (int j0 = 0; j0 < c; j0 += transpose_block) {
+						const int j1 = (std::min)(j0 + transpose_block, c);
+						for (int i = i0; i < i1; ++i) {
+							for (int j = j0; j < j1; ++j) {
+								a[j * r + i] = b[i * c + j];
+							}
+						}
+					}
 				}
 			}
+			val.array.rows = c;
+			val.array.columns = r;
 
 			return *this;
 		}
+		// Append columns of x in place.
 		OPER& hstack(const XLOPER12& x)
 		{
-			// Not efficient.
-			OPER x_(*this);
-			x_.transpose();
-			OPER _x(x);
-			_x.transpose();
-			vstack(_x);
-			x_.transpose();
-			std::swap(*this, x_);
+			if (aliases(x)) {
+				return hstack(OPER(x));
+			}
+			if (size(x) == 0) {
+				return *this;
+			}
+			if (size(*this) == 0) {
+				return operator=(x);
+			}
+			if (rows(*this) != rows(x)) {
+				return operator=(ErrValue);
+			}
+
+			const int cx = columns(x);
+			OPER* a = widen(cx);
+			const int c = columns(*this);
+			for (int i = 0; i < rows(*this); ++i) {
+				for (int j = 0; j < cx; ++j) {
+					new (a + i * c + c - cx + j) OPER(type(x) == xltypeMulti ? Multi(x)[i * cx + j] : x);
+				}
+			}
+			if (type(x) == xltypeMulti) {
+				share(x);
+			}
+
+			return *this;
+		}
+		// Move elements of x instead of copying them.
+		OPER& hstack(OPER&& x)
+		{
+			if (!x.isHeap() || aliases(x) || size(*this) == 0 || rows(*this) != rows(x)) {
+				return hstack(static_cast<const XLOPER12&>(x));
+			}
+
+			const int cx = columns(x);
+			OPER* a = widen(cx);
+			const int c = columns(*this);
+			for (int i = 0; i < rows(*this); ++i) {
+				std::memcpy(static_cast<void*>(a + i * c + c - cx), Multi(x) + i * cx, cx * sizeof(OPER));
+			}
+			take(x);
+			deallocate(x.val.array.lparray);
+			x.xltype = xltypeNil;
 
 			return *this;
 		}
 
 		// Append single item to row or column vector
 		OPER& append(const XLOPER12& x)
+		{
+			return append(OPER(x));
+		}
+		OPER& append(OPER&& x)
 		{
 			if (size(*this) == 0) {
-				operator=(x);
+				operator=(std::move(x));
 
 				return enlist();
 			}
@@ -542,83 +817,272 @@ namespace xll {
 			if (rows(*this) != 1 && columns(*this) != 1) {
 				return operator=(ErrValue);
 			}
-			int n = size(*this);
-			OPER o(1, n + 1);
-			for (int i = 0; i < n; ++i) {
-				o[i] = operator[](i);
-			}
-			o[n] = x;
 
-			std::swap(*this, o);	
-			if (rows(*this) != 1) {
-				std::swap(val.array.rows, val.array.columns);
+			OPER o(std::move(x)); // x might be an element of this
+			const int n = size(*this);
+			expand(n + 1);
+			std::memcpy(static_cast<void*>(Multi(*this) + n), &o, sizeof(OPER));
+			o.xltype = xltypeNil;
+			if (rows(*this) == 1) {
+				++val.array.columns;
+			}
+			else {
+				++val.array.rows;
 			}
 
 			return *this;
 		}
 
+		// Multi and nested strings and arrays in one allocation.
+		friend OPER arena(const XLOPER12& x);
+		// Replace nested multis with handles owned by the result.
+		friend OPER compress(const OPER& o);
+		// Memory owned by an arena block.
+		// o must hold memory allocated by OPER. Arguments passed in by Excel
+		// have no header in front of their strings and arrays.
+		friend bool isArena(const OPER& o) noexcept
+		{
+			return kind(o) == oper_header::arena;
+		}
+		// Multi owning an arena block. Same precondition as isArena.
+		friend bool isBlock(const OPER& o) noexcept
+		{
+			return o.xltype == xltypeMulti && kind(o) == oper_header::block;
+		}
+
 	private:
+		static constexpr int transpose_block = 16;
+
+		// Multi with elements in a heap array that can grow.
+		bool isHeap() const noexcept
+		{
+			return xltype == xltypeMulti && header(*this)->kind == oper_header::heap;
+		}
+		// True if x is this or one of its elements.
+		bool aliases(const XLOPER12& x) const noexcept
+		{
+			if (&x == this) {
+				return true;
+			}
+			if (xltype != xltypeMulti) {
+				return false;
+			}
+			const XLOPER12* a = Multi(*this);
+
+			return std::less_equal<const XLOPER12*>{}(a, &x) && std::less<const XLOPER12*>{}(&x, a + size(*this));
+		}
+		// Hold references to the handles held by the multi x whose elements were copied.
+		void share(const XLOPER12& x)
+		{
+			if (handles::share(Multi(x), Multi(*this))) {
+				header(*this)->flags |= oper_header::nested;
+			}
+		}
+		// Take the references held by the heap multi x whose elements were moved.
+		void take(OPER& x)
+		{
+			if (header(x)->flags & oper_header::nested) {
+				handles::move(Multi(x), Multi(*this));
+				header(*this)->flags |= oper_header::nested;
+			}
+		}
+		// Move elements to a heap array with capacity for n elements.
+		void grow(int n)
+		{
+			const int m = size(*this);
+			const XLOPER12 x = *this;
+			OPER* a = allocate<OPER>(n);
+			if (kind(x) && (header(x)->flags & oper_header::nested)) {
+				handles::move(Multi(x), a);
+				reinterpret_cast<oper_header*>(a)[-1].flags |= oper_header::nested;
+				header(x)->flags &= ~oper_header::nested;
+			}
+			if (isHeap()) {
+				std::memcpy(static_cast<void*>(a), Multi(x), m * sizeof(OPER));
+				deallocate(x.val.array.lparray);
+			}
+			else { // arena, block, or owned by Excel
+				std::uninitialized_copy_n(static_cast<const OPER*>(Multi(x)), m, a);
+				dealloc();
+			}
+			xltype = xltypeMulti;
+			val.array = { .lparray = a, .rows = rows(x), .columns = columns(x) };
+		}
+		// Geometric growth to hold at least n elements.
+		void expand(int n)
+		{
+			enlist();
+			if (n > capacity() || !isHeap()) {
+				grow((std::max)(n, isHeap() ? 2 * capacity() : n));
+			}
+		}
+		// Add cx uninitialized columns to the right of each row.
+		OPER* widen(int cx)
+		{
+			const int r = rows(*this);
+			const int c = columns(*this);
+			expand(r * (c + cx));
+			// Relocate rows from the back so they do not overwrite unmoved rows.
+			OPER* a = static_cast<OPER*>(Multi(*this));
+			for (int i = r - 1; i > 0; --i) {
+				std::memmove(static_cast<void*>(a + i * (c + cx)), a + i * c, c * sizeof(OPER));
+			}
+			val.array.columns += cx;
+
+			return a;
+		}
+		// Bytes used by n T's in an arena.
+		template<class T>
+		static constexpr size_t arena_bytes(size_t n) noexcept
+		{
+			constexpr size_t align = alignof(XLOPER12);
+
+			return sizeof(oper_header) + (n * sizeof(T) + align - 1) / align * align;
+		}
+		// Bytes needed to hold x in an arena.
+		static size_t arena_size(const XLOPER12& x) noexcept
+		{
+			size_t n = 0;
+
+			if (type(x) == xltypeStr) {
+				n = arena_bytes<XCHAR>(1 + static_cast<size_t>(count(x)));
+			}
+			else if (type(x) == xltypeMulti && size(x)) {
+				n = arena_bytes<OPER>(size(x));
+				for (int i = 0; i < size(x); ++i) {
+					n += arena_size(Multi(x)[i]);
+				}
+			}
+
+			return n;
+		}
+		// Place n T's at p and advance p.
+		template<class T>
+		static T* place(std::byte*& p, size_t n, unsigned short kind) noexcept
+		{
+			auto ph = reinterpret_cast<oper_header*>(p);
+			ph->kind = kind;
+			ph->flags = 0;
+			ph->capacity = static_cast<unsigned>(n);
+			p += arena_bytes<T>(n);
+
+			return reinterpret_cast<T*>(ph + 1);
+		}
+		// Allocate n T's preceded by a header.
+		template<class T>
+		static T* allocate(size_t n, size_t bytes = 0, unsigned short kind = oper_header::heap)
+		{
+			auto p = static_cast<std::byte*>(::operator new(sizeof(oper_header) + (std::max)(bytes, n * sizeof(T))));
+
+			return place<T>(p, n, kind);
+		}
+		static void deallocate(void* p) noexcept
+		{
+			::operator delete(static_cast<oper_header*>(p) - 1);
+		}
+		// Only valid for Str and Multi allocated by OPER.
+		static oper_header* header(const XLOPER12& x) noexcept
+		{
+			void* p = x.xltype == xltypeStr ? static_cast<void*>(x.val.str) : static_cast<void*>(x.val.array.lparray);
+
+			return static_cast<oper_header*>(p) - 1;
+		}
+		// Header kind of a Str or Multi allocated by OPER, otherwise 0.
+		// Memory returned by Excel has xlbitXLFree set and no header.
+		static unsigned short kind(const XLOPER12& x) noexcept
+		{
+			if ((x.xltype & xlbitXLFree) || (x.xltype != xltypeStr && x.xltype != xltypeMulti)) {
+				return 0;
+			}
+
+			return header(x)->kind;
+		}
+
 		void dealloc()
 		{
 			// xltype & xlbitDLLFree is freed when xlAutoFree12 is called.
 			if (xltype & xlbitXLFree) {
 				xltype &= ~xlbitXLFree;
-				::Excel12v(xlFree, 0, 1, (LPXLOPER12*)this);
+				LPXLOPER12 px = this;
+				::Excel12v(xlFree, 0, 1, &px);
 			}
 			else if (xltype == xltypeStr) {
-				delete[] val.str;
+				const unsigned short kind = header(*this)->kind;
+				if (kind == oper_header::heap) {
+					deallocate(val.str);
+				}
+				else if (kind == oper_header::interned) {
+					string_pool::instance().release(val.str);
+				}
 			}
 			else if (xltype == xltypeMulti) {
-				for (auto& o : span(*this)) {
-					static_cast<OPER&>(o).dealloc();
+				// Arena elements are not freed but may have been assigned heap values.
+				OPER* a = static_cast<OPER*>(Multi(*this));
+				if (header(*this)->flags & oper_header::nested) {
+					handles::release(a);
+				}
+				for (int i = 0; i < size(*this); ++i) {
+					a[i].dealloc();
+				}
+				if (header(*this)->kind != oper_header::arena) {
+					deallocate(a);
 				}
-				delete[] static_cast<OPER*>(Multi(*this));
 			}
 			else if (xltype == xltypeBigData) {
 				if (count(*this)) {
 					delete[] BigData(*this);
 				}
 			}
-			else if (xltype == xltypeNum) {
-				OPER* po = handles::find(val.num);
-				if (po) {
-					po->dealloc();
-				}
-			}
 
 			xltype = xltypeNil;
 		}
 
 		// Str
-		constexpr void alloc(const XCHAR* str, XCHAR len)
+		void alloc(const XCHAR* str, XCHAR len)
 		{
 			xltype = xltypeStr;
-			val.str = new XCHAR[1 + static_cast<size_t>(len)];
-			if (!val.str) {
+			val.str = allocate<XCHAR>(1 + static_cast<size_t>(len));
+			val.str[0] = len;
+			if (str && len) {
+				std::copy_n(str, len, val.str + 1);
+			}
+		}
+		// UTF-8 Str
+		void alloc(const char* str)
+		{
+			const int n = str && *str ? utf8::wcslen(str) : 1; // includes null terminator
+			if (n == 0 || n > WCHAR_MAX / 2) {
 				xltype = xltypeErr;
-				val.err = xlerrNA;
+				val.err = xlerrValue;
+
+				return;
 			}
-			else {
-				val.str[0] = len;
-				if (str && len) {
-					std::copy_n(str, len, val.str + 1);
-				}
+			xltype = xltypeStr;
+			val.str = allocate<XCHAR>(1 + static_cast<size_t>(n));
+			val.str[0] = static_cast<XCHAR>(n - 1);
+			val.str[n] = 0;
+			if (n > 1) {
+				utf8::mbstowcs(str, -1, val.str + 1, n);
 			}
 		}
 		// Multi
-		constexpr void alloc(int r, int c, const XLOPER12* a)
+		void alloc(int r, int c, const XLOPER12* a)
 		{
 			xltype = xltypeMulti;
 			val.array.rows = r;
 			val.array.columns = c;
 			val.array.lparray = nullptr;
 			if (size(*this)) {
-				val.array.lparray = new OPER[size(*this)];
+				OPER* pa = allocate<OPER>(size(*this));
 				if (a) {
 					for (int i = 0; i < r * c; ++i) {
-						new (val.array.lparray + i) OPER(a[i]);
+						new (pa + i) OPER(a[i]);
 					}
 				}
+				else {
+					std::uninitialized_default_construct_n(pa, size(*this));
+				}
+				val.array.lparray = pa;
 			}
 			else {
 				xltype = xltypeErr;
@@ -626,7 +1090,7 @@ namespace xll {
 			}
 		}
 		// BigData
-		constexpr void alloc(const BYTE* data, long len)
+		void alloc(const BYTE* data, long len)
 		{
 			xltype = xltypeBigData;
 			val.bigdata.cbData = len;
@@ -635,15 +1099,24 @@ namespace xll {
 				std::copy_n(data, len, val.bigdata.h.lpbData);
 			}
 		}
-		constexpr void alloc(const XLOPER12& x)
+		void alloc(const XLOPER12& x)
 		{
 			xltype = type(x);
 			switch (xltype) {
 			case xltypeStr:
-				alloc(Str(x), count(x));
+				if (string_pool::instance().contains(x.val.str)) {
+					val.str = x.val.str;
+					string_pool::addref(val.str);
+				}
+				else {
+					alloc(Str(x), count(x));
+				}
 				break;
 			case xltypeMulti:
 				alloc(rows(x), columns(x), Multi(x));
+				if (xltype == xltypeMulti) {
+					share(x);
+				}
 				break;
 			case xltypeBigData:
 				if (count(x)) {
@@ -658,9 +1131,236 @@ namespace xll {
 			}
 
 		}
+		// Multi owning a block holding all nested strings and arrays.
+		void alloc_arena(const XLOPER12& x)
+		{
+			const size_t n = arena_size(x) - sizeof(oper_header);
+			OPER* a = allocate<OPER>(size(x), n, oper_header::block);
+			std::byte* p = reinterpret_cast<std::byte*>(a + size(x));
+			std::uninitialized_default_construct_n(a, size(x));
+			for (int i = 0; i < size(x); ++i) {
+				a[i].alloc_arena(Multi(x)[i], p);
+			}
+			xltype = xltypeMulti;
+			val.array = { .lparray = a, .rows = rows(x), .columns = columns(x) };
+			share(x);
+		}
+		// Copy x into arena memory at p.
+		void alloc_arena(const XLOPER12& x, std::byte*& p)
+		{
+			if (type(x) == xltypeStr) {
+				xltype = xltypeStr;
+				val.str = place<XCHAR>(p, 1 + static_cast<size_t>(count(x)), oper_header::arena);
+				std::copy_n(x.val.str, 1 + count(x), val.str);
+			}
+			else if (type(x) == xltypeMulti && size(x)) {
+				OPER* a = place<OPER>(p, size(x), oper_header::arena);
+				std::uninitialized_default_construct_n(a, size(x));
+				for (int i = 0; i < size(x); ++i) {
+					a[i].alloc_arena(Multi(x)[i], p);
+				}
+				xltype = xltypeMulti;
+				val.array = { .lparray = a, .rows = rows(x), .columns = columns(x) };
+				share(x);
+			}
+			else {
+				operator=(x);
+			}
+		}
 	};
 
-	// Replace nested OPER with safe handles.
+	// Deep copy of x using a single allocation for nested strings and arrays.
+	// Elements can be reassigned. Elements moved out of the arena are copied.
+	inline OPER arena(const XLOPER12& x)
+	{
+		OPER o;
+
+		if (type(x) == xltypeMulti && size(x)) {
+			o.alloc_arena(x);
+		}
+		else {
+			o = x;
+		}
+
+		return o;
+	}
+
+	// Immutable string sharing one buffer with every equal interned string.
+	inline OPER intern(const XCHAR* str, XCHAR len)
+	{
+		OPER o;
+
+		XCHAR* p = string_pool::instance().intern(str, len);
+		if (p) {
+			o.xltype = xltypeStr;
+			o.val.str = p;
+		}
+		else {
+			o = OPER(str, len);
+		}
+
+		return o;
+	}
+	inline OPER intern(const std::wstring_view& str)
+	{
+		if (str.size() > 0x7FFF) {
+			return OPER(str);
+		}
+
+		return intern(str.data(), static_cast<XCHAR>(str.size()));
+	}
+	inline OPER intern(const XCHAR* str)
+	{
+		return intern(std::wstring_view(str ? str : L""));
+	}
+	// Convert short UTF-8 strings on the stack.
+	inline OPER intern(const char* str)
+	{
+		XCHAR buf[256];
+
+		const int n = str && *str ? utf8::wcslen(str) : 1; // includes null terminator
+		if (n <= 0 || n > 256) {
+			const OPER o(str);
+
+			return isStr(o) ? intern(o.val.str + 1, o.val.str[0]) : o;
+		}
+		if (n > 1) {
+			utf8::mbstowcs(str, -1, buf, n);
+		}
+
+		return intern(buf, static_cast<XCHAR>(n - 1));
+	}
+	inline bool isInterned(const XLOPER12& x)
+	{
+		return type(x) == xltypeStr && string_pool::instance().contains(x.val.str);
+	}
+
+	namespace detail {
+		struct nested_oper {
+			std::unique_ptr<OPER> po;
+			unsigned refs = 0;
+		};
+		struct nested_opers {
+			std::mutex m;
+			pointer_map<nested_oper> map;
+			// Handles referenced by each compressed multi keyed by its elements.
+			concurrent_pointer_map<std::vector<double>*> owned;
+		};
+	}
+	inline detail::nested_opers& handle_map()
+	{
+		// Never destroyed so static OPERs can erase handles at exit.
+		static auto* map = new detail::nested_opers;
+
+		return *map;
+	}
+	inline double handles::insert(OPER* po)
+	{
+		auto& h = handle_map();
+		std::lock_guard lock(h.m);
+		h.map.try_emplace(po, std::unique_ptr<OPER>(po), 1u);
+
+		return handle(po);
+	}
+	inline OPER* handles::find(double h)
+	{
+		auto& h_ = handle_map();
+		std::lock_guard lock(h_.m);
+		const auto p = h_.map.find(pointer(h));
+
+		return p ? p->po.get() : nullptr;
+	}
+	inline void handles::erase(double h)
+	{
+		// Destroyed after unlocking since nested handles are released recursively.
+		std::unique_ptr<OPER> po;
+		{
+			auto& h_ = handle_map();
+			std::lock_guard lock(h_.m);
+			auto p = h_.map.find(pointer(h));
+			if (p && --p->refs == 0) {
+				po = std::move(p->po);
+				h_.map.erase(pointer(h));
+			}
+		}
+	}
+	inline void handles::own(const void* a, double h)
+	{
+		auto& h_ = handle_map();
+		std::lock_guard lock(h_.m);
+		std::vector<double>* hs = nullptr;
+		if (!h_.owned.find(a, hs)) {
+			hs = new std::vector<double>;
+			h_.owned.insert(a, hs);
+		}
+		hs->push_back(h);
+	}
+	inline const std::vector<double>* handles::owned(const void* a) noexcept
+	{
+		std::vector<double>* hs = nullptr;
+
+		return handle_map().owned.find(a, hs) ? hs : nullptr;
+	}
+	inline bool handles::share(const void* a, const void* b)
+	{
+		const std::vector<double>* hs = owned(a);
+		if (!hs) {
+			return false;
+		}
+
+		auto& h_ = handle_map();
+		std::lock_guard lock(h_.m);
+		std::vector<double>* bs = nullptr;
+		if (!h_.owned.find(b, bs)) {
+			bs = new std::vector<double>;
+			h_.owned.insert(b, bs);
+		}
+		for (double h : *hs) {
+			if (auto p = h_.map.find(pointer(h))) {
+				++p->refs;
+				bs->push_back(h);
+			}
+		}
+
+		return true;
+	}
+	inline void handles::move(const void* a, const void* b)
+	{
+		auto& h_ = handle_map();
+		std::lock_guard lock(h_.m);
+		std::vector<double>* as = nullptr;
+		if (h_.owned.find(a, as)) {
+			h_.owned.erase(a);
+			std::vector<double>* bs = nullptr;
+			if (h_.owned.find(b, bs)) {
+				bs->insert(bs->end(), as->begin(), as->end());
+				delete as;
+			}
+			else {
+				h_.owned.insert(b, as);
+			}
+		}
+	}
+	inline void handles::release(const void* a)
+	{
+		std::vector<double>* hs = nullptr;
+		{
+			auto& h_ = handle_map();
+			std::lock_guard lock(h_.m);
+			if (h_.owned.find(a, hs)) {
+				h_.owned.erase(a);
+			}
+		}
+		if (hs) {
+			for (double h : *hs) {
+				erase(h);
+			}
+			delete hs;
+		}
+	}
+
+	// Replace nested OPER with handles held by the result.
+	// Copies hold their own references so handles live until the last copy is destroyed.
 	inline OPER compress(const OPER& o)
 	{
 		if (type(o) != xltypeMulti) {
@@ -671,18 +1371,37 @@ namespace xll {
 		for (OPER& oi : o_) {
 			if (isMulti(oi)) {
 				oi = handles::insert(new OPER(compress(oi)));
+				handles::own(Multi(o_), oi.val.num);
+				OPER::header(o_)->flags |= oper_header::nested;
 			}
 		}
 
 		return o_;
 	}
 
+	// Replace handles held by compressed multis with the OPER they refer to.
+	// Only elements recorded by compress are looked up. A number passed directly is a handle.
 	inline OPER expand(const OPER& o)
 	{
 		if (isMulti(o)) {
-			OPER o_(o);
-			for (OPER& oi : o_) {
-				oi = expand(oi);
+			std::vector<double> hs;
+			if (const auto* owned = handles::owned(Multi(o))) {
+				hs = *owned;
+				std::sort(hs.begin(), hs.end());
+			}
+			OPER o_(rows(o), columns(o));
+			for (int i = 0; i < size(o); ++i) {
+				const OPER& oi = o[i];
+				if (isMulti(oi)) {
+					o_[i] = expand(oi);
+				}
+				else if (type(oi) == xltypeNum && std::binary_search(hs.begin(), hs.end(), oi.val.num)) {
+					const OPER* po = handles::find(oi.val.num);
+					o_[i] = po ? expand(*po) : oi;
+				}
+				else {
+					o_[i] = oi;
+				}
 			}
 
 			return o_;
@@ -695,12 +1414,18 @@ namespace xll {
 		}
 
 		return o;
-
-
 	}
 
+	// Unordered containers keyed by OPER. Lookup also accepts XLOPER12 keys.
+	template<class T>
+	using oper_map = std::unordered_map<OPER, T, hash_xloper, equal_xloper>;
+	using oper_set = std::unordered_set<OPER, hash_xloper, equal_xloper>;
+
 } // namespace xll
 
+template<>
+struct std::hash<xll::OPER> : std::hash<XLOPER12> { };
+
 using LPOPER = xll::OPER*;
 
 static_assert(sizeof(xll::OPER) == sizeof(XLOPER12));
@@ -0,0 +1,229 @@
+// parallel.h - Element-wise loops over large arrays on a shared worker pool.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Only one loop runs on the pool at a time. A loop started while another is
+// running, or from inside a loop, runs serially on the caller. Excel calculation
+// threads never wait on each other. Calculation threads inside a loop count against
+// the cores so workers only join when Excel leaves cores idle.
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "fp.h"
+
+namespace xll {
+
+	// Smallest number of elements handed to a thread.
+	constexpr size_t parallel_grain = 4096;
+
+	class thread_pool {
+		struct loop {
+			void (*f)(void*, size_t, size_t);
+			void* ctx;
+			size_t n, grain;
+			std::atomic<size_t> next = 0;
+			std::atomic<bool> failed = false;
+			std::exception_ptr ex; // set by the first range to throw
+		};
+
+		std::atomic<bool> busy = false; // a loop is running
+		std::atomic<unsigned> active = 0; // callers and workers running loops
+		std::mutex m;
+		std::condition_variable work, idle;
+		std::vector<std::thread> workers;
+		loop* current = nullptr;
+		unsigned generation = 0;
+		unsigned inside = 0; // workers in current loop
+		bool stopping = false;
+
+		// Run ranges until none are left.
+		static void run(loop& l) noexcept
+		{
+			for (size_t b; !l.failed && (b = l.next.fetch_add(l.grain)) < l.n; ) {
+				try {
+					l.f(l.ctx, b, std::min(b + l.grain, l.n));
+				}
+				catch (...) {
+					if (!l.failed.exchange(true)) {
+						l.ex = std::current_exception();
+					}
+				}
+			}
+		}
+		// Loops after generation seen.
+		void worker(unsigned seen)
+		{
+			std::unique_lock lock(m);
+			for (;;) {
+				work.wait(lock, [&]() { return stopping || (current && generation != seen); });
+				if (stopping) {
+					return;
+				}
+				seen = generation;
+				// Sit out the loop if calculation threads are using the cores.
+				if (active.fetch_add(1) >= threads()) {
+					--active;
+					continue;
+				}
+				loop* l = current;
+				++inside;
+				lock.unlock();
+				run(*l);
+				lock.lock();
+				--active;
+				if (--inside == 0) {
+					idle.notify_all();
+				}
+			}
+		}
+		// Called with m held.
+		void start()
+		{
+			const size_t n = threads() - 1;
+			for (size_t i = 0; i < n; ++i) {
+				workers.emplace_back([this, seen = generation]() { worker(seen); });
+			}
+		}
+	public:
+		thread_pool() = default;
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+		~thread_pool()
+		{
+			stop();
+		}
+
+		// Pool shared by all add-ins in the xll.
+		// Never destroyed since workers cannot be joined while the DLL is unloading.
+		static thread_pool& instance()
+		{
+			static thread_pool* pool = new thread_pool;
+
+			return *pool;
+		}
+
+		// Threads a loop can use including the caller.
+		size_t threads() const noexcept
+		{
+			return std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		// Join the workers. They are started again by the next loop.
+		// Call from xlAutoClose since threads cannot be joined while the DLL is unloading.
+		void stop()
+		{
+			std::vector<std::thread> ws;
+			{
+				std::lock_guard lock(m);
+				stopping = true;
+				std::swap(ws, workers);
+			}
+			work.notify_all();
+			for (auto& w : ws) {
+				w.join();
+			}
+			std::lock_guard lock(m);
+			stopping = false;
+		}
+
+		// Call f(b, e) on disjoint ranges covering [0, n) at least grain long.
+		// Exceptions thrown by f are rethrown on the caller after every range has stopped.
+		template<class F>
+		void for_each(size_t n, size_t grain, F&& f)
+		{
+			grain = std::max<size_t>(grain, 1);
+			++active;
+			struct leave {
+				std::atomic<unsigned>& active;
+				~leave()
+				{
+					--active;
+				}
+			} leave_{ active };
+			if (n < 2 * grain || active >= threads() || busy.exchange(true)) {
+				if (n) {
+					f(size_t(0), n);
+				}
+
+				return;
+			}
+
+			// About four ranges per thread to balance uneven work.
+			using F_ = std::remove_reference_t<F>;
+			loop l{ [](void* ctx, size_t b, size_t e) { (*static_cast<F_*>(ctx))(b, e); },
+				const_cast<void*>(static_cast<const void*>(&f)), n, std::max(grain, n / (4 * threads()) + 1) };
+			{
+				std::lock_guard lock(m);
+				if (workers.empty()) {
+					start();
+				}
+				current = &l;
+				++generation;
+			}
+			work.notify_all();
+			run(l);
+			{
+				std::unique_lock lock(m);
+				current = nullptr;
+				idle.wait(lock, [this]() { return inside == 0; });
+			}
+			busy = false;
+
+			if (l.ex) {
+				std::rethrow_exception(l.ex);
+			}
+		}
+	};
+
+	// Call f(b, e) on disjoint ranges covering [0, n) using the shared pool.
+	template<class F>
+	inline void parallel_for(size_t n, F&& f, size_t grain = parallel_grain)
+	{
+		thread_pool::instance().for_each(n, grain, std::forward<F>(f));
+	}
+
+	// y[i] = f(x[i]). x and y may be the same.
+	template<class F>
+		requires std::invocable<F&, double>
+	inline void parallel_transform(std::span<const double> x, std::span<double> y, F f, size_t grain = parallel_grain)
+	{
+		ensure(x.size() == y.size() || !"parallel_transform: arrays must have the same size");
+
+		parallel_for(x.size(), [x, y, &f](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				y[i] = f(x[i]);
+			}
+		}, grain);
+	}
+
+	// z[i] = f(x[i], y[i]). z may be x or y.
+	template<class F>
+		requires std::invocable<F&, double, double>
+	inline void parallel_transform(std::span<const double> x, std::span<const double> y, std::span<double> z, F f, size_t grain = parallel_grain)
+	{
+		ensure((x.size() == y.size() && x.size() == z.size()) || !"parallel_transform: arrays must have the same size");
+
+		parallel_for(x.size(), [x, y, z, &f](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				z[i] = f(x[i], y[i]);
+			}
+		}, grain);
+	}
+
+	// a[i] = f(a[i])
+	template<class F>
+		requires std::invocable<F&, double>
+	inline _FP12& parallel_transform(_FP12& a, F f, size_t grain = parallel_grain)
+	{
+		parallel_transform(span(a), span(a), f, grain);
+
+		return a;
+	}
+
+} // namespace xll
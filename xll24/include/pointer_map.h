@@ -0,0 +1,172 @@
+// pointer_map.h - Open addressing hash table keyed by pointers.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Linear probing with backward shift deletion so erase leaves no tombstones.
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "ensure.h"
+
+namespace xll {
+
+	template<class V>
+	class pointer_map {
+		struct slot {
+			uintptr_t key; // 0 if empty
+			V value;
+		};
+		std::unique_ptr<slot[]> s;
+		size_t mask = 0; // capacity - 1
+		int shift = 64;  // 64 - log2(capacity)
+		size_t n = 0;
+
+		static uintptr_t key(const void* p) noexcept
+		{
+			return reinterpret_cast<uintptr_t>(p);
+		}
+		// Fibonacci hashing. Heap pointers have low bits zero.
+		size_t home(uintptr_t k) const noexcept
+		{
+			return static_cast<size_t>((static_cast<uint64_t>(k) * 0x9E3779B97F4A7C15ull) >> shift);
+		}
+		// Slot holding k or nullptr.
+		slot* lookup(uintptr_t k) const noexcept
+		{
+			if (k == 0 || n == 0) {
+				return nullptr;
+			}
+			for (size_t i = home(k); s[i].key; i = (i + 1) & mask) {
+				if (s[i].key == k) {
+					return &s[i];
+				}
+			}
+
+			return nullptr;
+		}
+		void rehash(size_t cap)
+		{
+			auto s_ = std::exchange(s, std::make_unique<slot[]>(cap));
+			const size_t mask_ = std::exchange(mask, cap - 1);
+			shift = 64 - std::countr_zero(cap);
+			if (s_) {
+				for (size_t i = 0; i <= mask_; ++i) {
+					if (s_[i].key) {
+						size_t j = home(s_[i].key);
+						while (s[j].key) {
+							j = (j + 1) & mask;
+						}
+						s[j] = std::move(s_[i]);
+					}
+				}
+			}
+		}
+	public:
+		constexpr pointer_map() noexcept = default;
+		pointer_map(const pointer_map&) = delete;
+		pointer_map& operator=(const pointer_map&) = delete;
+
+		size_t size() const noexcept
+		{
+			return n;
+		}
+		bool contains(const void* p) const noexcept
+		{
+			return lookup(key(p)) != nullptr;
+		}
+		V* find(const void* p) const noexcept
+		{
+			slot* ps = lookup(key(p));
+
+			return ps ? &ps->value : nullptr;
+		}
+		// Insert value if p is not a key. Null pointers are not stored.
+		template<class... Args>
+		std::pair<V*, bool> try_emplace(const void* p, Args&&... args)
+		{
+			const uintptr_t k = key(p);
+			if (k == 0) {
+				return { nullptr, false };
+			}
+			if (4 * (n + 1) > 3 * (mask + 1)) {
+				rehash(s ? 2 * (mask + 1) : 16);
+			}
+			size_t i = home(k);
+			for (; s[i].key; i = (i + 1) & mask) {
+				if (s[i].key == k) {
+					return { &s[i].value, false };
+				}
+			}
+			s[i].value = V(std::forward<Args>(args)...);
+			s[i].key = k;
+			++n;
+
+			return { &s[i].value, true };
+		}
+		// Null pointers are not keys.
+		V& operator[](const void* p)
+		{
+			ensure(p || !"pointer_map: null key");
+
+			return *try_emplace(p).first;
+		}
+		// The value is destroyed after the table is updated so its destructor can erase other keys.
+		bool erase(const void* p)
+		{
+			slot* ps = lookup(key(p));
+			if (!ps) {
+				return false;
+			}
+
+			[[maybe_unused]] V v = std::move(ps->value);
+			size_t i = ps - s.get();
+			for (size_t j = (i + 1) & mask; s[j].key; j = (j + 1) & mask) {
+				// Move back if the hole is between home and j.
+				if (((j - home(s[j].key)) & mask) >= ((j - i) & mask)) {
+					s[i] = std::move(s[j]);
+					i = j;
+				}
+			}
+			s[i].key = 0;
+			s[i].value = V{};
+			--n;
+
+			return true;
+		}
+		void clear()
+		{
+			s.reset();
+			mask = 0;
+			shift = 64;
+			n = 0;
+		}
+	};
+
+	class pointer_set {
+		pointer_map<bool> m;
+	public:
+		constexpr pointer_set() noexcept = default;
+
+		size_t size() const noexcept
+		{
+			return m.size();
+		}
+		bool contains(const void* p) const noexcept
+		{
+			return m.contains(p);
+		}
+		bool insert(const void* p)
+		{
+			return m.try_emplace(p, true).second;
+		}
+		bool erase(const void* p)
+		{
+			return m.erase(p);
+		}
+		void clear()
+		{
+			m.clear();
+		}
+	};
+
+} // namespace xll
@@ -26,13 +26,21 @@ namespace xll {
 		}
 	}
 
+	// Full path to the xll. Excel is called once and every add-in shares the string.
+	inline const OPER& ModuleText()
+	{
+		static const OPER name = intern(view(Excel(xlGetName)));
+
+		return name;
+	}
+
 	// Register a function or macro to be called by Excel.
 	// https://learn.microsoft.com/en-us/office/client-developer/excel/xlfregister-form-1
 	inline OPER XlfRegister(Args* pargs)
 	{
 		XLOPER12 res = { .xltype = xltypeNil };
 
-		pargs->moduleText = Excel(xlGetName);
+		pargs->moduleText = ModuleText();
 		procedure(pargs->procedure);
 		helpTopic(pargs->helpTopic);
 
@@ -75,7 +83,7 @@ namespace xll {
 		}
 		Excel(xlfSetName, procedure);
 		
-		regid = Excel(xlfRegister, Excel(xlGetName),
+		regid = Excel(xlfRegister, ModuleText(),
 			OPER("xlAutoRemove"), OPER(XLL_SHORT), procedure, Missing, OPER(2));
 		Excel(xlfSetName, procedure);
 
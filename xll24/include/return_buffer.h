@@ -0,0 +1,133 @@
+// return_buffer.h - Per thread memory for results of thread safe functions.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Excel copies a result before it calls another function on the same thread
+// so a buffer can be reused by a later call. Buffers keep their memory so
+// steady state calls do not allocate.
+#pragma once
+#include <deque>
+#include <vector>
+#include "fp.h"
+#include "oper.h"
+
+namespace xll {
+
+	// Results a thread can hold before the oldest buffer is reused.
+	// Allows functions returning buffers to call each other.
+	constexpr unsigned return_buffers = 4;
+
+	// Next buffer of type T on this thread.
+	template<class T>
+	inline T& return_buffer() noexcept
+	{
+		static thread_local T buf[return_buffers];
+		static thread_local unsigned i = 0;
+
+		return buf[i++ % return_buffers];
+	}
+
+	// Make o an r x c Multi reusing its memory. Elements are left over from earlier calls.
+	inline OPER& return_resize(OPER& o, int r, int c)
+	{
+		if (isMulti(o)) {
+			o.resize(r, c);
+		}
+		else {
+			o = OPER(r, c);
+		}
+
+		return o;
+	}
+
+	// r x c OPER buffer.
+	inline OPER& return_oper(int r, int c)
+	{
+		return return_resize(return_buffer<OPER>(), r, c);
+	}
+
+	// r x c FPX buffer. Elements are left over from earlier calls.
+	inline FPX& return_fp(int r, int c)
+	{
+		return return_buffer<FPX>().resize(r, c);
+	}
+	// r x c fixed size buffer with r * c at most N * M. Never allocates.
+	template<size_t N, size_t M>
+	inline fp12<N, M>& return_fp(int r, int c)
+	{
+		ensure((r >= 0 && c >= 0 && static_cast<size_t>(r) * c <= N * M) || !"return_fp: too many elements");
+
+		fp12<N, M>& a = return_buffer<fp12<N, M>>();
+		a.rows = r;
+		a.columns = c;
+
+		return a;
+	}
+
+	// OPERs returned with xlbitDLLFree set are given back by xlAutoFree12 instead of being destroyed.
+	// Excel calls xlAutoFree12 on the thread that called the function.
+	class dll_free_pool {
+		std::deque<OPER> opers; // stable addresses
+		std::vector<OPER*> available;
+		pointer_set used;
+	public:
+		dll_free_pool() = default;
+		dll_free_pool(const dll_free_pool&) = delete;
+		dll_free_pool& operator=(const dll_free_pool&) = delete;
+
+		static dll_free_pool& instance()
+		{
+			static thread_local dll_free_pool pool;
+
+			return pool;
+		}
+
+		// OPER to fill in and return with dll_free.
+		OPER& acquire()
+		{
+			if (available.empty()) {
+				available.push_back(&opers.emplace_back());
+			}
+			OPER* po = available.back();
+			available.pop_back();
+			used.insert(po);
+
+			return *po;
+		}
+		// r x c OPER to fill in and return with dll_free.
+		OPER& acquire(int r, int c)
+		{
+			return return_resize(acquire(), r, c);
+		}
+		// Return o from acquire to Excel.
+		LPXLOPER12 dll_free(OPER& o)
+		{
+			// Excel only calls xlAutoFree12 if memory is allocated.
+			if (!isAlloc(o)) {
+				release(&o);
+				return &o;
+			}
+
+			return DLLFree(o);
+		}
+		// Make px available to acquire. False if px is not in use in this pool.
+		bool release(LPXLOPER12 px)
+		{
+			if (!used.erase(px)) {
+				return false;
+			}
+			px->xltype &= ~xlbitDLLFree;
+			available.push_back(static_cast<OPER*>(px));
+
+			return true;
+		}
+
+		size_t size() const noexcept
+		{
+			return opers.size();
+		}
+		size_t in_use() const noexcept
+		{
+			return used.size();
+		}
+	};
+
+} // namespace xll
@@ -0,0 +1,508 @@
+// simd.h - Vectorized reductions over arrays of doubles.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Kernels are written once over a vector type and instantiated for
+// SSE2, AVX2 and AVX-512. The widest one the CPU supports is picked on first use.
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include "ensure.h"
+#if defined(_M_X64) || defined(__x86_64__)
+#define XLL_SIMD_X64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Instruction set of vector type member functions.
+// Kernel entry points inline everything they call.
+#if defined(__GNUC__) || defined(__clang__)
+#define XLL_SIMD_ISA(x) __attribute__((target(x)))
+#define XLL_SIMD_FLATTEN __attribute__((flatten))
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#else
+#define XLL_SIMD_ISA(x)
+#define XLL_SIMD_FLATTEN
+#endif
+
+namespace xll::simd {
+
+	enum class isa { scalar, sse2, avx2, avx512 };
+
+	// Widest instruction set supported by the CPU and operating system.
+	inline isa cpu_isa() noexcept
+	{
+#ifdef XLL_SIMD_X64
+		unsigned r1[4] = { 0 }, r7[4] = { 0 };
+#if defined(_MSC_VER)
+		int r[4];
+		__cpuid(r, 0);
+		const unsigned max = r[0];
+		__cpuid(r, 1);
+		for (int i = 0; i < 4; ++i) {
+			r1[i] = r[i];
+		}
+		if (max >= 7) {
+			__cpuidex(r, 7, 0);
+			for (int i = 0; i < 4; ++i) {
+				r7[i] = r[i];
+			}
+		}
+#else
+		const unsigned max = __get_cpuid_max(0, nullptr);
+		__cpuid(1, r1[0], r1[1], r1[2], r1[3]);
+		if (max >= 7) {
+			__cpuid_count(7, 0, r7[0], r7[1], r7[2], r7[3]);
+		}
+#endif
+		// OSXSAVE and AVX
+		if ((r1[2] & (1u << 27)) && (r1[2] & (1u << 28))) {
+#if defined(_MSC_VER)
+			const unsigned long long xcr0 = _xgetbv(0);
+#else
+			unsigned lo, hi;
+			__asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+			const unsigned long long xcr0 = (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+			// AVX512F with opmask and ZMM state enabled
+			if ((r7[1] & (1u << 16)) && (xcr0 & 0xE6) == 0xE6) {
+				return isa::avx512;
+			}
+			// AVX2 with YMM state enabled
+			if ((r7[1] & (1u << 5)) && (xcr0 & 0x6) == 0x6) {
+				return isa::avx2;
+			}
+		}
+
+		return isa::sse2;
+#else
+		return isa::scalar;
+#endif
+	}
+
+	namespace detail {
+
+		struct scalar {
+			using type = double;
+			using mask = bool;
+			static constexpr int width = 1;
+
+			static type load(const double* p) { return *p; }
+			static void store(double* p, type a) { *p = a; }
+			static type set1(double a) { return a; }
+			static type add(type a, type b) { return a + b; }
+			static type sub(type a, type b) { return a - b; }
+			static type mul(type a, type b) { return a * b; }
+			static mask lt(type a, type b) { return a < b; }
+			static type blend(type a, type b, mask m) { return m ? b : a; }
+			static type iota() { return 0; }
+			static type prefix(type a) { return a; }
+			static type last(type a) { return a; }
+			static double hsum(type a) { return a; }
+		};
+
+#ifdef XLL_SIMD_X64
+		struct sse2 {
+			using type = __m128d;
+			using mask = __m128d;
+			static constexpr int width = 2;
+
+			XLL_SIMD_ISA("sse2") static type load(const double* p) { return _mm_loadu_pd(p); }
+			XLL_SIMD_ISA("sse2") static void store(double* p, type a) { _mm_storeu_pd(p, a); }
+			XLL_SIMD_ISA("sse2") static type set1(double a) { return _mm_set1_pd(a); }
+			XLL_SIMD_ISA("sse2") static type add(type a, type b) { return _mm_add_pd(a, b); }
+			XLL_SIMD_ISA("sse2") static type sub(type a, type b) { return _mm_sub_pd(a, b); }
+			XLL_SIMD_ISA("sse2") static type mul(type a, type b) { return _mm_mul_pd(a, b); }
+			XLL_SIMD_ISA("sse2") static mask lt(type a, type b) { return _mm_cmplt_pd(a, b); }
+			XLL_SIMD_ISA("sse2") static type blend(type a, type b, mask m) { return _mm_or_pd(_mm_and_pd(m, b), _mm_andnot_pd(m, a)); }
+			XLL_SIMD_ISA("sse2") static type iota() { return _mm_set_pd(1, 0); }
+			// [a0, a0 + a1]
+			XLL_SIMD_ISA("sse2") static type prefix(type a) { return _mm_add_pd(a, _mm_unpacklo_pd(_mm_setzero_pd(), a)); }
+			XLL_SIMD_ISA("sse2") static type last(type a) { return _mm_unpackhi_pd(a, a); }
+			// Sum of lanes in a fixed order so results do not depend on alignment.
+			XLL_SIMD_ISA("sse2") static double hsum(type a)
+			{
+				double t[width], s = 0;
+				_mm_storeu_pd(t, a);
+				for (int k = 0; k < width; ++k) {
+					s += t[k];
+				}
+
+				return s;
+			}
+		};
+
+		struct avx2 {
+			using type = __m256d;
+			using mask = __m256d;
+			static constexpr int width = 4;
+
+			XLL_SIMD_ISA("avx2") static type load(const double* p) { return _mm256_loadu_pd(p); }
+			XLL_SIMD_ISA("avx2") static void store(double* p, type a) { _mm256_storeu_pd(p, a); }
+			XLL_SIMD_ISA("avx2") static type set1(double a) { return _mm256_set1_pd(a); }
+			XLL_SIMD_ISA("avx2") static type add(type a, type b) { return _mm256_add_pd(a, b); }
+			XLL_SIMD_ISA("avx2") static type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+			XLL_SIMD_ISA("avx2") static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+			XLL_SIMD_ISA("avx2") static mask lt(type a, type b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+			XLL_SIMD_ISA("avx2") static type blend(type a, type b, mask m) { return _mm256_blendv_pd(a, b, m); }
+			XLL_SIMD_ISA("avx2") static type iota() { return _mm256_set_pd(3, 2, 1, 0); }
+			// Add a shifted by one lane then the result shifted by two lanes.
+			XLL_SIMD_ISA("avx2") static type prefix(type a)
+			{
+				const type z = _mm256_setzero_pd();
+				a = _mm256_add_pd(a, _mm256_blend_pd(_mm256_permute4x64_pd(a, 0x90), z, 0x1));
+				return _mm256_add_pd(a, _mm256_blend_pd(_mm256_permute4x64_pd(a, 0x40), z, 0x3));
+			}
+			XLL_SIMD_ISA("avx2") static type last(type a) { return _mm256_permute4x64_pd(a, 0xFF); }
+			// Sum of lanes in a fixed order so results do not depend on alignment.
+			XLL_SIMD_ISA("avx2") static double hsum(type a)
+			{
+				double t[width], s = 0;
+				_mm256_storeu_pd(t, a);
+				for (int k = 0; k < width; ++k) {
+					s += t[k];
+				}
+
+				return s;
+			}
+		};
+
+		struct avx512 {
+			using type = __m512d;
+			using mask = __mmask8;
+			static constexpr int width = 8;
+
+			XLL_SIMD_ISA("avx512f") static type load(const double* p) { return _mm512_loadu_pd(p); }
+			XLL_SIMD_ISA("avx512f") static void store(double* p, type a) { _mm512_storeu_pd(p, a); }
+			XLL_SIMD_ISA("avx512f") static type set1(double a) { return _mm512_set1_pd(a); }
+			XLL_SIMD_ISA("avx512f") static type add(type a, type b) { return _mm512_add_pd(a, b); }
+			XLL_SIMD_ISA("avx512f") static type sub(type a, type b) { return _mm512_sub_pd(a, b); }
+			XLL_SIMD_ISA("avx512f") static type mul(type a, type b) { return _mm512_mul_pd(a, b); }
+			XLL_SIMD_ISA("avx512f") static mask lt(type a, type b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+			XLL_SIMD_ISA("avx512f") static type blend(type a, type b, mask m) { return _mm512_mask_blend_pd(m, a, b); }
+			XLL_SIMD_ISA("avx512f") static type iota() { return _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0); }
+			// Add a shifted by one, two and four lanes.
+			XLL_SIMD_ISA("avx512f") static type prefix(type a)
+			{
+				a = _mm512_add_pd(a, _mm512_maskz_permutexvar_pd(0xFE, _mm512_set_epi64(6, 5, 4, 3, 2, 1, 0, 0), a));
+				a = _mm512_add_pd(a, _mm512_maskz_permutexvar_pd(0xFC, _mm512_set_epi64(5, 4, 3, 2, 1, 0, 0, 0), a));
+				return _mm512_add_pd(a, _mm512_maskz_permutexvar_pd(0xF0, _mm512_set_epi64(3, 2, 1, 0, 0, 0, 0, 0), a));
+			}
+			XLL_SIMD_ISA("avx512f") static type last(type a) { return _mm512_permute_pd(_mm512_shuffle_f64x2(a, a, 0xFF), 0xFF); }
+			// Sum of lanes in a fixed order so results do not depend on alignment.
+			XLL_SIMD_ISA("avx512f") static double hsum(type a)
+			{
+				double t[width], s = 0;
+				_mm512_storeu_pd(t, a);
+				for (int k = 0; k < width; ++k) {
+					s += t[k];
+				}
+
+				return s;
+			}
+		};
+#endif // XLL_SIMD_X64
+
+		template<class V>
+		inline double sum(const double* x, size_t n)
+		{
+			auto s0 = V::set1(0), s1 = V::set1(0);
+			size_t i = 0;
+			for (; i + 2 * V::width <= n; i += 2 * V::width) {
+				s0 = V::add(s0, V::load(x + i));
+				s1 = V::add(s1, V::load(x + i + V::width));
+			}
+			double s = V::hsum(V::add(s0, s1));
+			for (; i < n; ++i) {
+				s += x[i];
+			}
+
+			return s;
+		}
+
+		// Kahan summation in each lane, then of the lanes.
+		template<class V>
+		inline double sum_kahan(const double* x, size_t n)
+		{
+			auto s = V::set1(0), c = V::set1(0);
+			size_t i = 0;
+			for (; i + V::width <= n; i += V::width) {
+				const auto y = V::sub(V::load(x + i), c);
+				const auto t = V::add(s, y);
+				c = V::sub(V::sub(t, s), y);
+				s = t;
+			}
+			double s_[V::width], c_[V::width];
+			V::store(s_, s);
+			V::store(c_, c);
+			double sk = 0, ck = 0;
+			auto step = [&sk, &ck](double xk) {
+				const double y = xk - ck;
+				const double t = sk + y;
+				ck = (t - sk) - y;
+				sk = t;
+			};
+			for (int k = 0; k < V::width; ++k) {
+				step(s_[k]);
+				step(-c_[k]);
+			}
+			for (; i < n; ++i) {
+				step(x[i]);
+			}
+
+			return sk;
+		}
+
+		template<class V>
+		inline double dot(const double* x, const double* y, size_t n)
+		{
+			auto s0 = V::set1(0), s1 = V::set1(0);
+			size_t i = 0;
+			for (; i + 2 * V::width <= n; i += 2 * V::width) {
+				s0 = V::add(s0, V::mul(V::load(x + i), V::load(y + i)));
+				s1 = V::add(s1, V::mul(V::load(x + i + V::width), V::load(y + i + V::width)));
+			}
+			double s = V::hsum(V::add(s0, s1));
+			for (; i < n; ++i) {
+				s += x[i] * y[i];
+			}
+
+			return s;
+		}
+
+		// Index of the first smallest (or largest) element ignoring NaNs. -1 if none.
+		// Indices are carried as doubles in the lanes.
+		template<class V, bool Max>
+		inline ptrdiff_t argmin(const double* x, size_t n)
+		{
+			const double inf = Max ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
+			auto m = V::set1(inf);
+			auto im = V::set1(-1);
+			auto ix = V::iota();
+			const auto w = V::set1(V::width);
+			size_t i = 0;
+			for (; i + V::width <= n; i += V::width) {
+				const auto xi = V::load(x + i);
+				const auto lt = Max ? V::lt(m, xi) : V::lt(xi, m);
+				m = V::blend(m, xi, lt);
+				im = V::blend(im, ix, lt);
+				ix = V::add(ix, w);
+			}
+			double m_[V::width], im_[V::width];
+			V::store(m_, m);
+			V::store(im_, im);
+			double mk = inf;
+			ptrdiff_t k = -1;
+			for (int j = 0; j < V::width; ++j) {
+				if (im_[j] >= 0 && (k == -1 || (Max ? m_[j] > mk : m_[j] < mk) || (m_[j] == mk && im_[j] < k))) {
+					mk = m_[j];
+					k = static_cast<ptrdiff_t>(im_[j]);
+				}
+			}
+			for (; i < n; ++i) {
+				if (Max ? x[i] > mk : x[i] < mk) {
+					mk = x[i];
+					k = i;
+				}
+			}
+			// Every element is NaN or infinite.
+			for (i = 0; k == -1 && i < n; ++i) {
+				if (x[i] == mk) {
+					k = i;
+				}
+			}
+
+			return k;
+		}
+
+		// Sum of squared deviations from m.
+		template<class V>
+		inline double sumsq(const double* x, size_t n, double m)
+		{
+			const auto m_ = V::set1(m);
+			auto s0 = V::set1(0), s1 = V::set1(0);
+			size_t i = 0;
+			for (; i + 2 * V::width <= n; i += 2 * V::width) {
+				const auto d0 = V::sub(V::load(x + i), m_);
+				const auto d1 = V::sub(V::load(x + i + V::width), m_);
+				s0 = V::add(s0, V::mul(d0, d0));
+				s1 = V::add(s1, V::mul(d1, d1));
+			}
+			double s = V::hsum(V::add(s0, s1));
+			for (; i < n; ++i) {
+				s += (x[i] - m) * (x[i] - m);
+			}
+
+			return s;
+		}
+
+		// y[i] = x[0] + ... + x[i]. x and y may be the same.
+		template<class V>
+		inline void prefix(const double* x, double* y, size_t n)
+		{
+			auto carry = V::set1(0);
+			size_t i = 0;
+			for (; i + V::width <= n; i += V::width) {
+				const auto yi = V::add(V::prefix(V::load(x + i)), carry);
+				V::store(y + i, yi);
+				carry = V::last(yi);
+			}
+			double c = i ? y[i - 1] : 0;
+			for (; i < n; ++i) {
+				c += x[i];
+				y[i] = c;
+			}
+		}
+
+		// y[i] += a * x[i]
+		template<class V>
+		inline void axpy(double a, const double* x, double* y, size_t n)
+		{
+			const auto a_ = V::set1(a);
+			size_t i = 0;
+			for (; i + V::width <= n; i += V::width) {
+				V::store(y + i, V::add(V::load(y + i), V::mul(a_, V::load(x + i))));
+			}
+			for (; i < n; ++i) {
+				y[i] += a * x[i];
+			}
+		}
+
+		struct kernels {
+			isa level;
+			double (*sum)(const double*, size_t);
+			double (*sum_kahan)(const double*, size_t);
+			double (*dot)(const double*, const double*, size_t);
+			ptrdiff_t (*argmin)(const double*, size_t);
+			ptrdiff_t (*argmax)(const double*, size_t);
+			double (*sumsq)(const double*, size_t, double);
+			void (*prefix)(const double*, double*, size_t);
+			void (*axpy)(double, const double*, double*, size_t);
+		};
+
+		// Entry points for vector type V with attributes A.
+#define XLL_SIMD_KERNELS(V, A) \
+		A XLL_SIMD_FLATTEN inline double sum_##V(const double* x, size_t n) { return sum<V>(x, n); } \
+		A XLL_SIMD_FLATTEN inline double sum_kahan_##V(const double* x, size_t n) { return sum_kahan<V>(x, n); } \
+		A XLL_SIMD_FLATTEN inline double dot_##V(const double* x, const double* y, size_t n) { return dot<V>(x, y, n); } \
+		A XLL_SIMD_FLATTEN inline ptrdiff_t argmin_##V(const double* x, size_t n) { return argmin<V, false>(x, n); } \
+		A XLL_SIMD_FLATTEN inline ptrdiff_t argmax_##V(const double* x, size_t n) { return argmin<V, true>(x, n); } \
+		A XLL_SIMD_FLATTEN inline double sumsq_##V(const double* x, size_t n, double m) { return sumsq<V>(x, n, m); } \
+		A XLL_SIMD_FLATTEN inline void prefix_##V(const double* x, double* y, size_t n) { prefix<V>(x, y, n); } \
+		A XLL_SIMD_FLATTEN inline void axpy_##V(double a, const double* x, double* y, size_t n) { axpy<V>(a, x, y, n); } \
+		constexpr kernels kernels_##V = { isa::V, sum_##V, sum_kahan_##V, dot_##V, argmin_##V, argmax_##V, sumsq_##V, prefix_##V, axpy_##V };
+
+		XLL_SIMD_KERNELS(scalar, )
+#ifdef XLL_SIMD_X64
+		XLL_SIMD_KERNELS(sse2, XLL_SIMD_ISA("sse2"))
+		XLL_SIMD_KERNELS(avx2, XLL_SIMD_ISA("avx2"))
+		XLL_SIMD_KERNELS(avx512, XLL_SIMD_ISA("avx512f"))
+#endif
+#undef XLL_SIMD_KERNELS
+
+	} // namespace detail
+
+	// Kernels for instruction set i, or the widest available if i is not supported.
+	inline const detail::kernels& kernels(isa i) noexcept
+	{
+#ifdef XLL_SIMD_X64
+		static const isa cpu = cpu_isa();
+		if (i > cpu) {
+			i = cpu;
+		}
+		switch (i) {
+		case isa::avx512:
+			return detail::kernels_avx512;
+		case isa::avx2:
+			return detail::kernels_avx2;
+		case isa::sse2:
+			return detail::kernels_sse2;
+		default:
+			break;
+		}
+#endif
+		return detail::kernels_scalar;
+	}
+	// Kernels selected for this CPU.
+	inline const detail::kernels& kernels() noexcept
+	{
+		static const detail::kernels& k = kernels(isa::avx512);
+
+		return k;
+	}
+
+	inline double sum(std::span<const double> x)
+	{
+		return kernels().sum(x.data(), x.size());
+	}
+	// Compensated sum.
+	inline double sum_kahan(std::span<const double> x)
+	{
+		return kernels().sum_kahan(x.data(), x.size());
+	}
+	inline double dot(std::span<const double> x, std::span<const double> y)
+	{
+		ensure(x.size() == y.size() || !"dot: arrays must have the same size");
+
+		return kernels().dot(x.data(), y.data(), x.size());
+	}
+	// Index of first smallest element ignoring NaNs or -1 if there is none.
+	inline ptrdiff_t argmin(std::span<const double> x)
+	{
+		return kernels().argmin(x.data(), x.size());
+	}
+	inline ptrdiff_t argmax(std::span<const double> x)
+	{
+		return kernels().argmax(x.data(), x.size());
+	}
+	inline double min(std::span<const double> x)
+	{
+		const ptrdiff_t i = argmin(x);
+
+		return i == -1 ? std::numeric_limits<double>::quiet_NaN() : x[i];
+	}
+	inline double max(std::span<const double> x)
+	{
+		const ptrdiff_t i = argmax(x);
+
+		return i == -1 ? std::numeric_limits<double>::quiet_NaN() : x[i];
+	}
+	inline double mean(std::span<const double> x)
+	{
+		return x.size() ? sum(x) / x.size() : std::numeric_limits<double>::quiet_NaN();
+	}
+	// Sample variance using two passes.
+	inline double variance(std::span<const double> x)
+	{
+		if (x.size() < 2) {
+			return std::numeric_limits<double>::quiet_NaN();
+		}
+
+		return kernels().sumsq(x.data(), x.size(), mean(x)) / (x.size() - 1);
+	}
+	// Running sums of x in y. x and y may be the same.
+	inline void prefix(std::span<const double> x, std::span<double> y)
+	{
+		ensure(x.size() == y.size() || !"prefix: arrays must have the same size");
+
+		kernels().prefix(x.data(), y.data(), x.size());
+	}
+	// y += a x
+	inline void axpy(double a, std::span<const double> x, std::span<double> y)
+	{
+		ensure(x.size() == y.size() || !"axpy: arrays must have the same size");
+
+		kernels().axpy(a, x.data(), y.data(), x.size());
+	}
+
+} // namespace xll::simd
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
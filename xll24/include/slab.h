@@ -0,0 +1,164 @@
+// slab.h - Per type free lists for objects owned by handles.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Blocks are carved from chunks and freed blocks are reused last in, first out.
+// A cell that recalculates gets back the block its previous object used so
+// creating and erasing handles in steady state does not call the global heap.
+// Derive T from slab_allocated<T> to opt in.
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <typeinfo>
+#include <vector>
+
+namespace xll {
+
+	struct slab_stats {
+		const char* name;   // typeid(T).name()
+		size_t size;        // bytes per block
+		size_t chunks;      // chunks from the global heap
+		size_t capacity;    // blocks in all chunks
+		size_t in_use;      // blocks allocated and not freed
+		size_t allocations; // calls to allocate
+		size_t frees;       // calls to deallocate
+	};
+
+	// Free list of fixed size blocks. Thread safe.
+	class slab {
+		struct block {
+			block* next;
+		};
+		// Blocks in the first and largest chunks.
+		static constexpr size_t first = 64;
+		static constexpr size_t largest = 4096;
+
+		const char* name;
+		size_t align, size;
+		mutable std::mutex m;
+		block* free = nullptr;
+		std::vector<void*> chunk;
+		size_t capacity = 0, in_use = 0, allocations = 0, frees = 0;
+
+		// Add a chunk to the free list. Called with m held.
+		void grow()
+		{
+			const size_t n = std::min(largest, first << std::min<size_t>(chunk.size(), 6));
+			chunk.reserve(chunk.size() + 1);
+			char* p = static_cast<char*>(::operator new(n * size, std::align_val_t(align)));
+			chunk.push_back(p);
+			for (size_t i = n; i-- > 0; ) {
+				block* b = reinterpret_cast<block*>(p + i * size);
+				b->next = free;
+				free = b;
+			}
+			capacity += n;
+		}
+
+		// Slabs live until the process exits so objects deleted by static destructors can be freed.
+		static std::vector<slab*>& all()
+		{
+			static auto* all_ = new std::vector<slab*>;
+
+			return *all_;
+		}
+		static std::mutex& all_mutex()
+		{
+			static auto* m_ = new std::mutex;
+
+			return *m_;
+		}
+	public:
+		slab(const char* name, size_t size, size_t align)
+			: name(name), align(std::max(align, alignof(block))),
+			  size((std::max(size, sizeof(block)) + this->align - 1) / this->align * this->align)
+		{
+			std::lock_guard lock(all_mutex());
+			all().push_back(this);
+		}
+		slab(const slab&) = delete;
+		slab& operator=(const slab&) = delete;
+		~slab()
+		{
+			{
+				std::lock_guard lock(all_mutex());
+				std::erase(all(), this);
+			}
+			for (void* p : chunk) {
+				::operator delete(p, std::align_val_t(align));
+			}
+		}
+
+		void* allocate()
+		{
+			std::lock_guard lock(m);
+			if (!free) {
+				grow();
+			}
+			block* b = free;
+			free = b->next;
+			++in_use;
+			++allocations;
+
+			return b;
+		}
+		void deallocate(void* p) noexcept
+		{
+			if (!p) {
+				return;
+			}
+			std::lock_guard lock(m);
+			block* b = static_cast<block*>(p);
+			b->next = free;
+			free = b;
+			--in_use;
+			++frees;
+		}
+
+		slab_stats stats() const
+		{
+			std::lock_guard lock(m);
+
+			return { name, size, chunk.size(), capacity, in_use, allocations, frees };
+		}
+		// Call f(slab_stats) for every slab.
+		template<class F>
+		static void for_each(F&& f)
+		{
+			std::lock_guard lock(all_mutex());
+			for (const slab* s : all()) {
+				f(s->stats());
+			}
+		}
+	};
+
+	// Slab for objects of type T.
+	template<class T>
+	inline slab& slab_of()
+	{
+		static slab* s = new slab(typeid(T).name(), sizeof(T), alignof(T));
+
+		return *s;
+	}
+
+	// Base class giving T class specific new and delete from slab_of<T>().
+	// Derived classes of a different size use the global heap.
+	// Use a virtual destructor when deleting through a base pointer.
+	template<class T>
+	struct slab_allocated {
+		static void* operator new(size_t n)
+		{
+			return n == sizeof(T) ? slab_of<T>().allocate() : ::operator new(n, std::align_val_t(alignof(T)));
+		}
+		static void operator delete(void* p, size_t n) noexcept
+		{
+			if (n == sizeof(T)) {
+				slab_of<T>().deallocate(p);
+			}
+			else {
+				::operator delete(p, std::align_val_t(alignof(T)));
+			}
+		}
+	};
+
+} // namespace xll
@@ -0,0 +1,566 @@
+// snapshot.h - Save handle objects when the add-in closes and restore them when it opens.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+// Specialize serialize<T> to write and read a T. A handle created with a snapshot_key
+// of the constructor inputs is saved in a file when the add-in closes. When the add-in
+// opens the file is mapped into memory. A handle created with a key in the file does not
+// call the constructor and the object is read from the file the first time it is used.
+// Different inputs give a different key so entries for stale inputs are never used.
+// Handle numbers differ between sessions so a handle input contributes the key of the
+// object it refers to, and objects made from handles without a key are not saved.
+// Snapshots are off unless the add-in calls snapshot::enable(). A restored object is
+// trusted to be the result of its inputs so only use them for immutable types.
+#pragma once
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "oper.h"
+#include "win_mem_view.h"
+
+namespace xll {
+
+	// Append values to a snapshot entry.
+	class snapshot_writer {
+		std::string& buf;
+	public:
+		explicit snapshot_writer(std::string& buf)
+			: buf(buf)
+		{ }
+
+		snapshot_writer& put(const void* p, size_t n)
+		{
+			buf.append(static_cast<const char*>(p), n);
+
+			return *this;
+		}
+		template<class T>
+			requires std::is_trivially_copyable_v<T>
+		snapshot_writer& put(const T& t)
+		{
+			return put(&t, sizeof(T));
+		}
+		snapshot_writer& put(std::string_view s)
+		{
+			put<uint64_t>(s.size());
+
+			return put(s.data(), s.size());
+		}
+		// References are not values and cannot be saved.
+		snapshot_writer& put(const XLOPER12& x)
+		{
+			put<uint32_t>(type(x));
+			switch (type(x)) {
+			case xltypeNum:
+				return put(x.val.num);
+			case xltypeStr:
+				put<XCHAR>(x.val.str[0]);
+				return put(x.val.str + 1, x.val.str[0] * sizeof(XCHAR));
+			case xltypeBool:
+				return put<int32_t>(x.val.xbool);
+			case xltypeErr:
+				return put<int32_t>(x.val.err);
+			case xltypeInt:
+				return put<int32_t>(x.val.w);
+			case xltypeMulti:
+				put<int32_t>(rows(x));
+				put<int32_t>(columns(x));
+				for (int i = 0; i < size(x); ++i) {
+					put(Multi(x)[i]);
+				}
+				return *this;
+			case xltypeNil:
+			case xltypeMissing:
+				return *this;
+			}
+
+			throw std::runtime_error("snapshot_writer: type cannot be saved");
+		}
+		snapshot_writer& put(const OPER& o)
+		{
+			return put(static_cast<const XLOPER12&>(o));
+		}
+	};
+
+	// Read values of a snapshot entry in the order they were written.
+	class snapshot_reader {
+		const char* b;
+		const char* e;
+	public:
+		explicit snapshot_reader(std::string_view s)
+			: b(s.data()), e(s.data() + s.size())
+		{ }
+
+		size_t size() const noexcept
+		{
+			return e - b;
+		}
+
+		snapshot_reader& get(void* p, size_t n)
+		{
+			ensure(n <= size() || !"snapshot_reader: read past end of entry");
+			std::memcpy(p, b, n);
+			b += n;
+
+			return *this;
+		}
+		template<class T>
+			requires std::is_trivially_copyable_v<T>
+		T get()
+		{
+			T t;
+			get(&t, sizeof(T));
+
+			return t;
+		}
+		std::string get_string()
+		{
+			const uint64_t n = get<uint64_t>();
+			ensure(n <= size() || !"snapshot_reader: read past end of entry");
+			std::string s(b, n);
+			b += n;
+
+			return s;
+		}
+		OPER get_oper()
+		{
+			switch (get<uint32_t>()) {
+			case xltypeNum:
+				return OPER(get<double>());
+			case xltypeStr: {
+				const XCHAR n = get<XCHAR>();
+				std::wstring s(n, 0);
+				get(s.data(), n * sizeof(XCHAR));
+				return OPER(std::wstring_view(s));
+			}
+			case xltypeBool:
+				return OPER(get<int32_t>() != 0);
+			case xltypeErr:
+				return OPER(static_cast<xlerr>(get<int32_t>()));
+			case xltypeInt:
+				return OPER(static_cast<int>(get<int32_t>()));
+			case xltypeMulti: {
+				const int r = get<int32_t>();
+				const int c = get<int32_t>();
+				ensure((r >= 0 && c >= 0) || !"snapshot_reader: invalid array");
+				OPER o(r, c);
+				for (int i = 0; i < r * c; ++i) {
+					o[i] = get_oper();
+				}
+				return o;
+			}
+			case xltypeNil:
+				return OPER{};
+			case xltypeMissing:
+				return OPER(Missing);
+			}
+
+			throw std::runtime_error("snapshot_reader: invalid type");
+		}
+	};
+
+	// Specialize with
+	// static void write(snapshot_writer&, const T&);
+	// static T* read(snapshot_reader&);
+	// static constexpr uint32_t version = ...; // optional, change when the format changes
+	template<class T>
+	struct serialize;
+
+	template<class T>
+	concept serializable = requires(snapshot_writer& w, snapshot_reader& r, const T& t) {
+		serialize<T>::write(w, t);
+		{ serialize<T>::read(r) } -> std::convertible_to<T*>;
+	};
+
+	template<class T>
+	constexpr uint32_t serialize_version()
+	{
+		if constexpr (requires { serialize<T>::version; }) {
+			return serialize<T>::version;
+		}
+		else {
+			return 0;
+		}
+	}
+
+	// Defined in handle.h. True if x is a live slot handle and set key to the snapshot key
+	// of its object, or 0 if it was not created with a key.
+	inline bool snapshot_handle_key(double x, uint64_t& key) noexcept;
+
+	// Content hash of constructor inputs.
+	// Numbers that are live slot handles, also in arrays, hash as the key of their object.
+	// Other numbers, including stale handles, hash as numbers.
+	// Pointer handles from to_handle are not recognized and must not be used.
+	class snapshot_key {
+		uint64_t k;
+		bool none = false; // an input is a handle without a key
+
+		uint64_t part(double x) noexcept
+		{
+			uint64_t key;
+			if (snapshot_handle_key(x, key)) {
+				none = none || !key;
+
+				return key;
+			}
+
+			return hash(Num(x));
+		}
+		uint64_t part(const XLOPER12& x) noexcept
+		{
+			if (type(x) == xltypeNum) {
+				return part(x.val.num);
+			}
+			if (type(x) == xltypeMulti) {
+				// Same as hash(x) if there are no handles.
+				uint64_t h = hash_combine(hash_mix(xltypeMulti), (static_cast<uint64_t>(rows(x)) << 32) | static_cast<uint32_t>(columns(x)));
+				for (int i = 0; i < size(x); ++i) {
+					h = hash_combine(h, part(Multi(x)[i]));
+				}
+
+				return h;
+			}
+
+			return hash(x);
+		}
+		template<class T>
+			requires std::is_arithmetic_v<T>
+		uint64_t part(T t) noexcept
+		{
+			return part(static_cast<double>(t));
+		}
+		static uint64_t part(std::wstring_view s) noexcept
+		{
+			uint64_t h = 0xCBF29CE484222325ull;
+			for (wchar_t c : s) {
+				h = (h ^ c) * 0x100000001B3ull;
+			}
+
+			return hash_mix(h);
+		}
+	public:
+		template<class... Ts>
+		explicit snapshot_key(const Ts&... ts) noexcept
+			: k(hash_mix(sizeof...(Ts)))
+		{
+			((k = hash_combine(k, part(ts))), ...);
+			// 0 means no key.
+			k = none ? 0 : k | 1;
+		}
+		uint64_t value() const noexcept
+		{
+			return k;
+		}
+	};
+
+	// Id of T stable across sessions.
+	template<class T>
+	inline uint64_t snapshot_type()
+	{
+		static const uint64_t id = [] {
+			uint64_t h = 0xCBF29CE484222325ull;
+			for (const char* s = typeid(T).name(); *s; ++s) {
+				h = (h ^ static_cast<unsigned char>(*s)) * 0x100000001B3ull;
+			}
+			return hash_mix(h);
+		}();
+
+		return id;
+	}
+
+	// Snapshot file mapped when the add-in opens and rewritten when it closes.
+	// The file has a header followed by entries aligned to 8 bytes.
+	class snapshot {
+		struct header {
+			char magic[8];
+			uint32_t format;
+			uint32_t reserved;
+			uint64_t count;
+			uint64_t build; // id of the add-in that wrote the file
+		};
+		static constexpr char magic[8] = { 'X', 'L', 'L', 'S', 'N', 'A', 'P', 0 };
+		static constexpr uint32_t format = 2;
+	public:
+		struct entry {
+			uint64_t type;
+			uint64_t key;
+			uint32_t version;
+			uint32_t size; // bytes following the entry
+		};
+		// Entries of the next snapshot.
+		class out {
+			std::string buf;
+			uint64_t count = 0;
+			std::set<std::pair<uint64_t, uint64_t>> keys;
+			uint64_t build;
+		public:
+			out(uint64_t build = 0)
+				: build(build)
+			{
+				buf.append(sizeof(header), 0);
+			}
+			// Add an entry written by f(snapshot_writer&). Later entries with the same key are ignored.
+			// Objects that cannot be written are left out.
+			template<class F>
+			bool add(uint64_t type, uint64_t key, uint32_t version, F&& f)
+			{
+				if (keys.contains({ type, key })) {
+					return false;
+				}
+				const size_t off = buf.size();
+				try {
+					buf.append(sizeof(entry), 0);
+					snapshot_writer w(buf);
+					f(w);
+					const size_t n = buf.size() - off - sizeof(entry);
+					ensure(n <= UINT32_MAX || !"snapshot: entry too large");
+					const entry e{ type, key, version, static_cast<uint32_t>(n) };
+					std::memcpy(buf.data() + off, &e, sizeof(entry));
+					buf.append((8 - buf.size() % 8) % 8, 0);
+					keys.emplace(type, key);
+				}
+				catch (const std::exception&) {
+					buf.resize(off);
+
+					return false;
+				}
+				++count;
+
+				return true;
+			}
+			// Contents of a snapshot file.
+			const std::string& data()
+			{
+				header h{ {}, format, 0, count, build };
+				std::memcpy(h.magic, magic, sizeof(magic));
+				std::memcpy(buf.data(), &h, sizeof(header));
+
+				return buf;
+			}
+			uint64_t size() const noexcept
+			{
+				return count;
+			}
+		};
+	private:
+		Win::file_view view;
+		std::string copy; // contents after the file was replaced
+		std::string_view file;
+		std::unordered_map<uint64_t, uint64_t> index; // type and key to offset of entry
+		uint64_t build = 0; // files written by another build are not used
+		// Write the live objects of each handle type.
+		std::vector<void (*)(out&)> savers;
+		mutable std::mutex m;
+
+		static uint64_t index_key(uint64_t type, uint64_t key) noexcept
+		{
+			return hash_combine(type, key);
+		}
+		// Index entries of file. False if it is not a snapshot of this build.
+		bool load()
+		{
+			index.clear();
+			header h;
+			if (file.size() < sizeof(header)) {
+				return false;
+			}
+			std::memcpy(&h, file.data(), sizeof(header));
+			if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.format != format || h.build != build) {
+				return false;
+			}
+			uint64_t off = sizeof(header);
+			for (uint64_t i = 0; i < h.count; ++i) {
+				entry e;
+				if (file.size() - off < sizeof(entry)) {
+					return false;
+				}
+				std::memcpy(&e, file.data() + off, sizeof(entry));
+				if (file.size() - off - sizeof(entry) < e.size) {
+					return false;
+				}
+				index.try_emplace(index_key(e.type, e.key), off);
+				off += sizeof(entry) + e.size;
+				off += (8 - off % 8) % 8;
+			}
+
+			return true;
+		}
+	public:
+		snapshot() = default;
+		snapshot(const snapshot&) = delete;
+		snapshot& operator=(const snapshot&) = delete;
+
+		static snapshot& instance()
+		{
+			static snapshot s;
+
+			return s;
+		}
+
+		// Snapshots are off unless an add-in calls this before xlAutoOpen, e.g. to initialize
+		// a static. The file is named after the xll and only used by the same build of it.
+		// Defined in snapshot.cpp.
+		static bool enable();
+
+		// Use the contents of a snapshot file written by build. They must stay valid until close.
+		// Handles refer to entries by offset so a snapshot can only be opened once.
+		// The next save is written for build even if data is not used.
+		bool attach(std::string_view data, uint64_t build_ = 0)
+		{
+			std::lock_guard lock(m);
+			if (!file.empty()) {
+				return false;
+			}
+			build = build_;
+			file = data;
+			if (!load()) {
+				file = {};
+				index.clear();
+				return false;
+			}
+
+			return true;
+		}
+		// Map a snapshot file. False if it does not exist or is not valid.
+		bool open(const std::filesystem::path& path, uint64_t build_ = 0)
+		{
+			Win::file_view v(path.c_str());
+			std::string_view data(v.data(), v.size());
+			if (!attach(data, build_)) {
+				return false;
+			}
+			std::lock_guard lock(m);
+			view = std::move(v);
+
+			return true;
+		}
+		// Entries are no longer available.
+		void close()
+		{
+			std::lock_guard lock(m);
+			index.clear();
+			file = {};
+			view.close();
+			std::string().swap(copy);
+		}
+		// Keep entries in memory and unmap the file so it can be replaced.
+		// Offsets do not change so objects not yet read can still be read.
+		void detach()
+		{
+			std::lock_guard lock(m);
+			if (!view.data()) {
+				return;
+			}
+			copy.assign(file.data(), file.size());
+			file = copy;
+			view.close();
+		}
+		size_t size() const
+		{
+			std::lock_guard lock(m);
+
+			return index.size();
+		}
+
+		// Offset of the entry for type and key or 0.
+		uint64_t find(uint64_t type, uint64_t key, uint32_t version) const
+		{
+			std::lock_guard lock(m);
+			const auto i = index.find(index_key(type, key));
+			if (i == index.end()) {
+				return 0;
+			}
+			entry e;
+			std::memcpy(&e, file.data() + i->second, sizeof(entry));
+
+			return e.type == type && e.key == key && e.version == version ? i->second : 0;
+		}
+		// Bytes of the entry at off. Empty if the snapshot was closed.
+		std::string_view data(uint64_t off) const
+		{
+			std::lock_guard lock(m);
+			if (off == 0 || off + sizeof(entry) > file.size()) {
+				return {};
+			}
+			entry e;
+			std::memcpy(&e, file.data() + off, sizeof(entry));
+
+			return file.substr(off + sizeof(entry), e.size);
+		}
+		// Read the T at off.
+		template<class T>
+			requires serializable<T>
+		T* read(uint64_t off) const
+		{
+			const std::string_view s = data(off);
+			if (s.data() == nullptr) {
+				return nullptr;
+			}
+			snapshot_reader r(s);
+
+			return serialize<T>::read(r);
+		}
+
+		// Call f(out&) when saving. Added once per type.
+		void add_saver(void (*f)(out&))
+		{
+			std::lock_guard lock(m);
+			if (std::find(savers.begin(), savers.end(), f) == savers.end()) {
+				savers.push_back(f);
+			}
+		}
+		// Entries of all live objects created with a key.
+		out save() const
+		{
+			std::vector<void (*)(out&)> fs;
+			uint64_t b;
+			{
+				std::lock_guard lock(m);
+				fs = savers;
+				b = build;
+			}
+			out o(b);
+			for (auto f : fs) {
+				f(o);
+			}
+
+			return o;
+		}
+		// Replace the snapshot file and return the number of entries. Entries of this snapshot
+		// are kept in memory and can be used until it is closed, so the add-in can keep running.
+		// The file is kept if no handles were created with a key.
+		uint64_t save(const std::filesystem::path& path)
+		{
+			{
+				std::lock_guard lock(m);
+				if (savers.empty()) {
+					return 0;
+				}
+			}
+			out o = save();
+			auto tmp = path;
+			tmp += L".tmp";
+			{
+				std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+				const std::string& data = o.data();
+				ofs.write(data.data(), data.size());
+				ensure(ofs.good() || !"snapshot: failed to write file");
+			}
+			detach();
+			std::filesystem::rename(tmp, path);
+
+			return o.size();
+		}
+	};
+
+} // namespace xll
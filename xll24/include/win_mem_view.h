@@ -1,8 +1,10 @@
 // win_mem_view.cpp - memory mapped data
+#pragma once
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <memoryapi.h>
+#include <utility>
 #include "ensure.h"
 
 namespace Win {
@@ -99,6 +101,73 @@ namespace Win {
 		}
 	};
 
+	// Read only view of an entire file.
+	class file_view {
+		HANDLE f = INVALID_HANDLE_VALUE;
+		HANDLE m = NULL;
+		const char* buf = nullptr;
+		size_t len = 0;
+	public:
+		file_view() = default;
+		// Empty view if the file does not exist.
+		explicit file_view(const wchar_t* path)
+			: f(CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr))
+		{
+			LARGE_INTEGER size;
+			if (f == INVALID_HANDLE_VALUE || !GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+				return;
+			}
+			m = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (m != NULL) {
+				buf = static_cast<const char*>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+				len = buf ? static_cast<size_t>(size.QuadPart) : 0;
+			}
+		}
+		file_view(const file_view&) = delete;
+		file_view& operator=(const file_view&) = delete;
+		file_view(file_view&& v) noexcept
+		{
+			*this = std::move(v);
+		}
+		file_view& operator=(file_view&& v) noexcept
+		{
+			if (this != &v) {
+				close();
+				f = std::exchange(v.f, INVALID_HANDLE_VALUE);
+				m = std::exchange(v.m, HANDLE(NULL));
+				buf = std::exchange(v.buf, nullptr);
+				len = std::exchange(v.len, 0);
+			}
+
+			return *this;
+		}
+		~file_view()
+		{
+			close();
+		}
+
+		// Unmap so the file can be replaced.
+		void close() noexcept
+		{
+			if (buf) UnmapViewOfFile(buf);
+			if (m != NULL) CloseHandle(m);
+			if (f != INVALID_HANDLE_VALUE) CloseHandle(f);
+			f = INVALID_HANDLE_VALUE;
+			m = NULL;
+			buf = nullptr;
+			len = 0;
+		}
+
+		const char* data() const noexcept
+		{
+			return buf;
+		}
+		size_t size() const noexcept
+		{
+			return len;
+		}
+	};
+
 	// class alocator...
 
 } // namespace Win
\ No newline at end of file
@@ -4,8 +4,11 @@
 #include "export.h"
 #include "alert.h"
 #include "fp.h"
+#include "fp_oper.h"
 #include "on.h"
 #include "handle.h"
+#include "key_index.h"
+#include "return_buffer.h"
 #include "addin.h"
 #include "excel_time.h"
 #include "enum.h"
@@ -29,9 +32,7 @@ namespace xll {
 		// Full path to xll.
 		static const OPER& GetName()
 		{
-			static const OPER name = Excel(xlGetName);
-
-			return name;
+			return ModuleText();
 		}
 		static OPER Modules()
 		{
@@ -1,6 +1,8 @@
 // xloper.h - XLOPER12 helpers
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
 #pragma once
+#include <bit>
+#include <cstdint>
 #include <iostream>
 #include <string_view>
 #include "ref.h"
@@ -137,6 +139,9 @@ namespace xll {
 		case xltypeNum:
 			return x.val.num <=> y.val.num;
 		case xltypeStr:
+			if (x.val.str == y.val.str) { // shared buffer
+				return std::partial_ordering::equivalent;
+			}
 			return std::lexicographical_compare_three_way(view(x).begin(), view(x).end(), view(y).begin(), view(y).end());
 		case xltypeBool:
 			return x.val.xbool <=> y.val.xbool;
@@ -161,6 +166,98 @@ namespace xll {
 		return std::partial_ordering::equivalent;
 	}
 
+	// Mix bits so nearby keys land in different buckets.
+	constexpr size_t hash_mix(uint64_t h) noexcept
+	{
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+
+		return static_cast<size_t>(h);
+	}
+	constexpr size_t hash_combine(size_t h, uint64_t v) noexcept
+	{
+		return hash_mix(h ^ (v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2)));
+	}
+
+	// Hash consistent with compare: equal values have equal hashes.
+	constexpr size_t hash(const XLOPER12& x) noexcept
+	{
+		const int xtype = type(x);
+		size_t h = hash_mix(xtype);
+
+		switch (xtype) {
+		case xltypeNum:
+			// -0.0 == 0.0 and all NaNs hash the same.
+			return hash_combine(h, x.val.num == 0 ? 0
+				: x.val.num != x.val.num ? 0x7FF8000000000000ull
+				: std::bit_cast<uint64_t>(x.val.num));
+		case xltypeStr:
+			// FNV-1a over characters.
+			h ^= 0xCBF29CE484222325ull;
+			for (XCHAR c : view(x)) {
+				h = (h ^ c) * 0x100000001B3ull;
+			}
+			return hash_mix(h);
+		case xltypeBool:
+			return hash_combine(h, x.val.xbool != 0);
+		case xltypeErr:
+			return hash_combine(h, x.val.err);
+		case xltypeMulti:
+			h = hash_combine(h, (static_cast<uint64_t>(rows(x)) << 32) | static_cast<uint32_t>(columns(x)));
+			for (int i = 0; i < size(x); ++i) {
+				h = hash_combine(h, hash(Multi(x)[i]));
+			}
+			return h;
+		case xltypeInt:
+			return hash_combine(h, static_cast<uint32_t>(x.val.w));
+		case xltypeSRef:
+			return hash_combine(hash_combine(h, (static_cast<uint64_t>(x.val.sref.ref.rwFirst) << 32) | static_cast<uint32_t>(x.val.sref.ref.rwLast)),
+				(static_cast<uint64_t>(x.val.sref.ref.colFirst) << 32) | static_cast<uint32_t>(x.val.sref.ref.colLast));
+		case xltypeRef:
+			h = hash_combine(h, x.val.mref.idSheet);
+			for (const auto& r : ref(x)) {
+				h = hash_combine(hash_combine(h, (static_cast<uint64_t>(r.rwFirst) << 32) | static_cast<uint32_t>(r.rwLast)),
+					(static_cast<uint64_t>(r.colFirst) << 32) | static_cast<uint32_t>(r.colLast));
+			}
+			return h;
+		case xltypeBigData:
+			h = hash_combine(h, count(x));
+			for (BYTE b : blob(x)) {
+				h = (h ^ b) * 0x100000001B3ull;
+			}
+			return hash_mix(h);
+		}
+
+		return h;
+	}
+#ifdef _DEBUG
+	static_assert(hash(Num(0.)) == hash(Num(-0.)));
+	static_assert(hash(Num(1)) != hash(Num(2)));
+	static_assert(hash(Num(1)) != hash(Int(1)));
+	static_assert(hash(Str(L"\3abc")) == hash(Str(L"\3abc")));
+	static_assert(hash(Str(L"\3abc")) != hash(Str(L"\3abd")));
+	static_assert(hash(Nil) == hash(Nil));
+#endif // _DEBUG
+
+	// Transparent hash and equality for unordered containers keyed by OPER.
+	struct hash_xloper {
+		using is_transparent = void;
+		size_t operator()(const XLOPER12& x) const noexcept
+		{
+			return hash(x);
+		}
+	};
+	struct equal_xloper {
+		using is_transparent = void;
+		bool operator()(const XLOPER12& x, const XLOPER12& y) const noexcept
+		{
+			return compare(x, y) == 0;
+		}
+	};
+
 	// Index of value in JSON like multi corresponding to key.
 	constexpr int lookup(const XLOPER12& x, const XLOPER12& key) noexcept
 	{
@@ -262,6 +359,14 @@ constexpr bool operator==(const XLOPER12& x, const XLOPER12& y)
 	return xll::compare(x, y) == 0;
 }
 
+template<>
+struct std::hash<XLOPER12> {
+	size_t operator()(const XLOPER12& x) const noexcept
+	{
+		return xll::hash(x);
+	}
+};
+
 #ifdef _DEBUG
 static_assert((xll::Num(1.23) <=> xll::Num(1.23)) == 0);
 static_assert((xll::Num(1.23) <=> xll::Num(1.24)) < 0);
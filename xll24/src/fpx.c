@@ -1,5 +1,7 @@
 // fpx.c - C VLA implementation of the fpx.h interface.
 // Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "fpx.h"
@@ -9,9 +11,184 @@ int fpx_index(struct fpx* p, int i, int j)
 	return p->columns * i + j;
 }
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#ifdef _MSC_VER
+#include <malloc.h>
+#define FPX_THREAD __declspec(thread)
+#else
+#define FPX_THREAD _Thread_local
+#endif
+
+static inline size_t fpx_min(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+// Blocks start on an FPX_ALIGN boundary and struct fpx is placed so array
+// starts on the next one. Capacity and allocator are kept in front of struct fpx
+// so its layout stays that of _FP12.
+#define FPX_OFFSET (FPX_ALIGN - offsetof(struct fpx, array))
+
+struct fpx_header {
+	size_t capacity; // number of doubles array can hold
+	const struct fpx_allocator* allocator; // used to free the block
+};
+
+static inline struct fpx_header* fpx_header(struct fpx* p)
+{
+	return (struct fpx_header*)p - 1;
+}
+
+// Bytes in a block holding n doubles rounded up to a multiple of FPX_ALIGN.
+static inline size_t fpx_bytes(size_t n)
+{
+	return (FPX_ALIGN + n * sizeof(double) + FPX_ALIGN - 1) & ~(size_t)(FPX_ALIGN - 1);
+}
+
+static void* fpx_aligned_alloc(void* ctx, size_t bytes)
+{
+	(void)ctx;
+#ifdef _MSC_VER
+	return _aligned_malloc(bytes, FPX_ALIGN);
+#else
+	return aligned_alloc(FPX_ALIGN, bytes);
+#endif
+}
+static void fpx_aligned_free(void* ctx, void* p, size_t bytes)
+{
+	(void)ctx;
+	(void)bytes;
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+const struct fpx_allocator fpx_allocator_aligned = { fpx_aligned_alloc, fpx_aligned_free, NULL };
+
+// Blocks smaller than this come from the aligned heap.
+#define FPX_PAGES_MIN (1 << 20)
+
+// Large pages need the SeLockMemoryPrivilege so fall back to ordinary pages.
+static void* fpx_pages_alloc(void* ctx, size_t bytes)
+{
+	if (bytes < FPX_PAGES_MIN) {
+		return fpx_aligned_alloc(ctx, bytes);
+	}
+#ifdef _WIN32
+	const size_t large = GetLargePageMinimum();
+	void* p = NULL;
+	if (large) {
+		p = VirtualAlloc(NULL, (bytes + large - 1) & ~(large - 1), MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+	}
+	if (!p) {
+		p = VirtualAlloc(NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	}
+
+	return p;
+#else
+	return fpx_aligned_alloc(ctx, bytes);
+#endif
+}
+static void fpx_pages_free(void* ctx, void* p, size_t bytes)
+{
+	if (bytes < FPX_PAGES_MIN) {
+		fpx_aligned_free(ctx, p, bytes);
+		return;
+	}
+#ifdef _WIN32
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	fpx_aligned_free(ctx, p, bytes);
+#endif
+}
+const struct fpx_allocator fpx_allocator_pages = { fpx_pages_alloc, fpx_pages_free, NULL };
+
+static void* fpx_arena_alloc(void* ctx, size_t bytes)
+{
+	struct fpx_arena* a = ctx;
+	const uintptr_t base = (uintptr_t)a->base;
+	const uintptr_t p = (base + a->used + FPX_ALIGN - 1) & ~(uintptr_t)(FPX_ALIGN - 1);
+
+	if (p - base + bytes > a->size) {
+		return NULL;
+	}
+	a->used = p - base + bytes;
+
+	return (void*)p;
+}
+// Only the most recent block is given back.
+static void fpx_arena_free(void* ctx, void* p, size_t bytes)
+{
+	struct fpx_arena* a = ctx;
+
+	if ((char*)p + bytes == a->base + a->used) {
+		a->used -= bytes;
+	}
+}
+
+void fpx_arena_init(struct fpx_arena* a, void* buf, size_t size)
+{
+	a->base = buf;
+	a->size = size;
+	a->used = 0;
+	a->allocator.alloc = fpx_arena_alloc;
+	a->allocator.free = fpx_arena_free;
+	a->allocator.ctx = a;
+}
+
+void fpx_arena_reset(struct fpx_arena* a)
+{
+	a->used = 0;
+}
+
+static FPX_THREAD const struct fpx_allocator* fpx_allocator_ = NULL;
+
+const struct fpx_allocator* fpx_get_allocator(void)
+{
+	return fpx_allocator_ ? fpx_allocator_ : &fpx_allocator_aligned;
+}
+
+const struct fpx_allocator* fpx_set_allocator(const struct fpx_allocator* a)
+{
+	const struct fpx_allocator* _a = fpx_get_allocator();
+
+	fpx_allocator_ = a;
+
+	return _a;
+}
+
+// Allocate or reallocate p to hold n doubles using the allocator of p or the current one.
+// Use the aligned heap if the allocator has no memory.
+static struct fpx* fpx_alloc(struct fpx* p, size_t n)
+{
+	const struct fpx_allocator* a = p ? fpx_header(p)->allocator : fpx_get_allocator();
+	void* b = a->alloc(a->ctx, fpx_bytes(n));
+
+	if (!b && a != &fpx_allocator_aligned) {
+		a = &fpx_allocator_aligned;
+		b = a->alloc(a->ctx, fpx_bytes(n));
+	}
+	if (!b) {
+		return (void*)0;
+	}
+
+	struct fpx* _p = (struct fpx*)((char*)b + FPX_OFFSET);
+	fpx_header(_p)->capacity = n;
+	fpx_header(_p)->allocator = a;
+	if (p) {
+		memcpy(_p, p, offsetof(struct fpx, array) + fpx_min(fpx_header(p)->capacity, n) * sizeof(double));
+		fpx_free(p);
+	}
+
+	return _p;
+}
+
 struct fpx* fpx_malloc(int r, int c)
 {
-	struct fpx* fpx = malloc(sizeof(struct fpx) + (size_t)r * (size_t)c * sizeof(double));
+	struct fpx* fpx = fpx_alloc((void*)0, (size_t)r * (size_t)c);
 
 	if (fpx) {
 		fpx->rows = r;
@@ -21,44 +198,185 @@ struct fpx* fpx_malloc(int r, int c)
 	return fpx;
 }
 
+// Only reallocates if r*c is more than the capacity.
 struct fpx* fpx_realloc(struct fpx* p, int r, int c)
 {
-	struct fpx* _p = realloc(p, sizeof(struct fpx) + (size_t)r * (size_t)c * sizeof(double));
+	struct fpx* _p = p;
 
+	if (!p || (size_t)r * (size_t)c > fpx_header(p)->capacity) {
+		_p = fpx_alloc(p, (size_t)r * (size_t)c);
+	}
 	if (_p) {
 		_p->rows = r;
 		_p->columns = c;
 	}
 
-	return _p ? _p : (void*)0;
+	return _p;
+}
+
+int fpx_capacity(struct fpx* p)
+{
+	return p ? (int)fpx_header(p)->capacity : 0;
+}
+
+struct fpx* fpx_reserve(struct fpx* p, int n)
+{
+	if (p && (size_t)n <= fpx_header(p)->capacity) {
+		return p;
+	}
+
+	struct fpx* _p = fpx_alloc(p, (size_t)n);
+	if (_p && !p) {
+		_p->rows = 0;
+		_p->columns = 0;
+	}
+
+	return _p;
+}
+
+struct fpx* fpx_shrink_to_fit(struct fpx* p)
+{
+	if (!p || (size_t)fpx_size(p) == fpx_header(p)->capacity) {
+		return p;
+	}
+
+	return fpx_alloc(p, (size_t)fpx_size(p));
 }
 
 void fpx_free(struct fpx* p)
 {
-	free(p);
+	if (p) {
+		const struct fpx_allocator* a = fpx_header(p)->allocator;
+		a->free(a->ctx, (char*)p - FPX_OFFSET, fpx_bytes(fpx_header(p)->capacity));
+	}
+}
+
+// Side of square tiles that fit in L1 cache.
+#define FPX_TRANSPOSE_BLOCK 32
+
+// Transpose the n x n block of a with row stride ld one pair of tiles at a time.
+// Tile (i, j) is copied to scratch t, tile (j, i) is transposed into it, and
+// t is transposed into tile (j, i) so each pass reads and writes whole tile rows.
+static void fpx_transpose_square(double* a, size_t n, size_t ld)
+{
+	double t[FPX_TRANSPOSE_BLOCK * FPX_TRANSPOSE_BLOCK];
+
+	for (size_t i0 = 0; i0 < n; i0 += FPX_TRANSPOSE_BLOCK) {
+		const size_t h = fpx_min(FPX_TRANSPOSE_BLOCK, n - i0);
+		for (size_t i = 0; i < h; ++i) {
+			// Diagonal tiles only swap above the diagonal.
+			for (size_t j = i + 1; j < h; ++j) {
+				const double x = a[(i0 + i) * ld + i0 + j];
+				a[(i0 + i) * ld + i0 + j] = a[(i0 + j) * ld + i0 + i];
+				a[(i0 + j) * ld + i0 + i] = x;
+			}
+		}
+		for (size_t j0 = i0 + FPX_TRANSPOSE_BLOCK; j0 < n; j0 += FPX_TRANSPOSE_BLOCK) {
+			const size_t w = fpx_min(FPX_TRANSPOSE_BLOCK, n - j0);
+			double* aij = a + i0 * ld + j0;
+			double* aji = a + j0 * ld + i0;
+			for (size_t i = 0; i < h; ++i) {
+				memcpy(t + i * w, aij + i * ld, w * sizeof(double));
+			}
+			for (size_t i = 0; i < h; ++i) {
+				for (size_t j = 0; j < w; ++j) {
+					aij[i * ld + j] = aji[j * ld + i];
+				}
+			}
+			for (size_t j = 0; j < w; ++j) {
+				for (size_t i = 0; i < h; ++i) {
+					aji[j * ld + i] = t[i * w + j];
+				}
+			}
+		}
+	}
+}
+
+// Position of item k of an r x c matrix in its transpose.
+static inline size_t fpx_transpose_index(size_t k, size_t r, size_t c)
+{
+	return (k % c) * r + k / c;
+}
+
+// Transpose r x c matrix a in place where each item is m contiguous doubles
+// by rotating each permutation cycle through scratch x of 2m doubles.
+// Visited items are kept in a bit set. If that cannot be allocated
+// a cycle is only rotated from its smallest item.
+static void fpx_transpose_cycle(double* a, size_t r, size_t c, size_t m, double* x)
+{
+	const size_t n = r * c;
+	double* y = x + m;
+	unsigned char* seen = calloc((n + 7) / 8, 1);
+
+	for (size_t k = 1; k + 1 < n; ++k) {
+		if (seen) {
+			if (seen[k / 8] & (1u << (k % 8))) {
+				continue;
+			}
+		}
+		else {
+			size_t l = fpx_transpose_index(k, r, c);
+			while (l > k) {
+				l = fpx_transpose_index(l, r, c);
+			}
+			if (l < k) {
+				continue;
+			}
+		}
+
+		memcpy(x, a + k * m, m * sizeof(double));
+		size_t l = k;
+		do {
+			l = fpx_transpose_index(l, r, c);
+			memcpy(y, a + l * m, m * sizeof(double));
+			memcpy(a + l * m, x, m * sizeof(double));
+			double* t = x;
+			x = y;
+			y = t;
+			if (seen) {
+				seen[l / 8] |= (unsigned char)(1u << (l % 8));
+			}
+		} while (l != k);
+	}
+
+	free(seen);
 }
 
-// TODO: use dimatcopy
+// Square matrices swap tiles in place through a scratch tile. If one side is
+// q times the other the q square blocks are transposed in place and their rows
+// permuted by cycles. Other shapes follow cycles of elements in place.
 struct fpx* fpx_transpose(struct fpx* fpx)
 {
-	int r = fpx_rows(fpx);
-	int c = fpx_columns(fpx);
-	int n = fpx_size(fpx);
+	const size_t r = fpx_rows(fpx);
+	const size_t c = fpx_columns(fpx);
+	double* a = fpx->array;
+	double x[2];
 
 	if (r > 1 && c > 1) {
-		struct fpx* fpx_ = fpx_malloc(c, r);
-		if (fpx_) {
-			memcpy(fpx_->array, fpx->array, n * sizeof(double));
-			for (int k = 1; k < n - 1; ++k) {
-				// if 0 < k < n - 1 and k = c j + i then
-				// r k % (n - 1) = (r c j + r i) % (n - 1) = j + (n - 1) j + r i % (n - 1) = j + r i
-				fpx->array[(r * k) % (n - 1)] = fpx_->array[k];
+		double* row = (r == c || (c % r && r % c)) ? NULL : malloc(2 * fpx_min(r, c) * sizeof(double));
+		if (r == c) {
+			fpx_transpose_square(a, r, c);
+		}
+		else if (row && c % r == 0) {
+			// Block k row i is at row i of block k.
+			for (size_t k = 0; k < c; k += r) {
+				fpx_transpose_square(a + k, r, c);
 			}
-			fpx_free(fpx_);
+			fpx_transpose_cycle(a, r, c / r, r, row);
+		}
+		else if (row && r % c == 0) {
+			fpx_transpose_cycle(a, r / c, c, c, row);
+			for (size_t k = 0; k < r; k += c) {
+				fpx_transpose_square(a + k, c, r);
+			}
+		}
+		else {
+			fpx_transpose_cycle(a, r, c, 1, x);
 		}
+		free(row);
 	}
-	fpx->rows = c;
-	fpx->columns = r;
+	fpx->rows = (int)c;
+	fpx->columns = (int)r;
 
 	return fpx;
 }
@@ -0,0 +1,12 @@
+// parallel.cpp - Lifetime of the shared worker pool.
+#include "xll.h"
+#include "parallel.h"
+
+using namespace xll;
+
+// Workers must be joined before Excel unloads the DLL.
+Auto<Close> xac_thread_pool([]() {
+	thread_pool::instance().stop();
+
+	return TRUE;
+});
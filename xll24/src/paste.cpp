@@ -63,40 +63,248 @@ OPER Formula(const Args* pargs)
 	return formula;
 }
 
-// Translate by r rows and c columns.
-OPER Move(const XLOPER12& o, int r, int c, int w = 1, int h = 1)
+// Relative R1C1 reference to ref from cell, like xlfRelref.
+OPER Relref(const XLREF12& ref, const XLREF12& cell)
 {
-	OPER sel = Excel(xlfOffset, o, r, c, w, h);
-	OPER s = Excel(xlcSelect, sel);
-	return sel;
+	auto rc = [](int r, int c) {
+		std::wstring s(L"R");
+		if (r) {
+			s += L"[" + std::to_wstring(r) + L"]";
+		}
+		s += L"C";
+		if (c) {
+			s += L"[" + std::to_wstring(c) + L"]";
+		}
+		return s;
+	};
+	std::wstring s = rc(ref.rwFirst - cell.rwFirst, ref.colFirst - cell.colFirst);
+	if (size(ref) > 1) {
+		s += L":" + rc(ref.rwLast - cell.rwFirst, ref.colLast - cell.colFirst);
+	}
+
+	return OPER(s);
 }
 
-// Expand active to size of ref.
-OPER Reshape(const OPER& active, const OPER& ref)
+// Active cell on the active sheet.
+REF Active()
 {
-	return OPER(reshape(SRef(active), rows(ref), columns(ref)));
+	const OPER active = Excel(xlfActiveCell);
+	if (isSRef(active)) {
+		return REF(SRef(active));
+	}
+
+	return REF(static_cast<int>(asNum(Excel(xlfRow, active))) - 1, static_cast<int>(asNum(Excel(xlfColumn, active))) - 1);
 }
 
-// Set value and return selection.
-OPER Set(const OPER& ref, const OPER& val)
-{
-	OPER res = ref;
+// Collect the writes of a paste and apply them with as few Excel calls as possible.
+// Layout is computed in process instead of moving the selection around the sheet.
+class Paste {
+	struct block {
+		REF ref;
+		OPER value;
+	};
+	std::vector<block> values;   // xlSet
+	std::vector<block> formulas; // xlcFormula
+	std::vector<std::pair<OPER, REF>> names; // xlcDefineName
+	std::vector<std::pair<OPER, std::vector<REF>>> styles; // xlcApplyStyle
+	struct format_group {
+		void(*f)(); // macro functions applied to the selection
+		int n;      // number of Excel calls f makes
+		std::vector<REF> refs;
+	};
+	std::vector<format_group> formats;
+	// Join vertically adjacent references with the same columns.
+	static std::vector<REF> join(std::vector<REF> refs)
+	{
+		std::stable_sort(refs.begin(), refs.end(), [](const REF& a, const REF& b) {
+			return a.colFirst < b.colFirst || (a.colFirst == b.colFirst && a.rwFirst < b.rwFirst);
+		});
+		std::vector<REF> areas;
+		for (const auto& r : refs) {
+			if (!areas.empty()) {
+				REF& a = areas.back();
+				if (a.colFirst == r.colFirst && a.colLast == r.colLast && a.rwLast + 1 == r.rwFirst) {
+					a.rwLast = r.rwLast;
+					continue;
+				}
+			}
+			areas.push_back(r);
+		}
+
+		return areas;
+	}
+	// Select all areas with one call.
+	void select(const std::vector<REF>& refs)
+	{
+		const auto areas = join(refs);
+		if (areas.size() == 1) {
+			Excel(xlcSelect, OPER(areas[0]));
+			++calls;
+
+			return;
+		}
 
-	if (isFormula(val)) {
-		OPER eval = Excel(xlfEvaluate, val);
-		if (isMulti(eval)) {
-			res = Reshape(ref, eval);
-			Excel(xlSet, res, eval);
+		if (!idSheet) {
+			idSheet = Excel(xlSheetId).val.mref.idSheet;
+			++calls;
+		}
+		auto buf = std::make_unique<char[]>(sizeof(XLMREF12) + (areas.size() - 1) * sizeof(XLREF12));
+		XLMREF12* pm = reinterpret_cast<XLMREF12*>(buf.get());
+		pm->count = static_cast<WORD>(areas.size());
+		std::copy(areas.begin(), areas.end(), pm->reftbl);
+		XLOPER12 ref;
+		ref.xltype = xltypeRef;
+		ref.val.mref.lpmref = pm;
+		ref.val.mref.idSheet = idSheet;
+		Excel(xlcSelect, ref);
+		++calls;
+	}
+	IDSHEET idSheet = 0;
+	REF selection; // selected after apply
+public:
+	int calls = 0; // Excel calls made
+	int cells = 0; // Excel calls made writing one cell at a time
+
+	// Queue val with upper left cell at and return the range written.
+	REF value(const REF& at, const OPER& val)
+	{
+		if (isFormula(val)) {
+			OPER eval = Excel(xlfEvaluate, val);
+			++calls;
+			++cells;
+			if (!isMulti(eval)) {
+				formula(at, val);
+
+				return at;
+			}
+			values.emplace_back(reshape(at, rows(eval), columns(eval)), std::move(eval));
 		}
 		else {
-			Excel(xlcFormula, val, res);
+			values.emplace_back(reshape(at, rows(val), columns(val)), val);
+		}
+		++cells;
+
+		return values.back().ref;
+	}
+	void formula(const REF& ref, const OPER& val)
+	{
+		formulas.emplace_back(ref, val);
+		++cells;
+	}
+	void name(const OPER& name, const REF& ref)
+	{
+		names.emplace_back(name, ref);
+		++cells;
+	}
+	// Select and apply style.
+	void style(const REF& ref, const OPER& style)
+	{
+		auto i = std::find_if(styles.begin(), styles.end(), [&style](const auto& g) { return g.first == style; });
+		if (i == styles.end()) {
+			i = styles.insert(i, { style, {} });
+		}
+		i->second.push_back(ref);
+		cells += 2;
+	}
+	// Select and call n macro functions.
+	void format(const REF& ref, void(*f)(), int n)
+	{
+		auto i = std::find_if(formats.begin(), formats.end(), [f](const auto& g) { return g.f == f; });
+		if (i == formats.end()) {
+			i = formats.insert(i, { f, n, {} });
 		}
+		i->refs.push_back(ref);
+		cells += 1 + n;
+	}
+	// Select ref after everything else is applied.
+	void select(const REF& ref)
+	{
+		selection = ref;
+		++cells;
 	}
-	else {
-		Excel(xlSet, ref, val);
+	// Moving the selection used xlfOffset and xlcSelect.
+	void move()
+	{
+		cells += 2;
 	}
+	// Relative reference without calling xlfRelref.
+	OPER relref(const REF& ref, const REF& cell)
+	{
+		++cells;
 
-	return res;
+		return Relref(ref, cell);
+	}
+
+	// Styles are applied in the order queued so the last one leaves its range selected.
+	void apply()
+	{
+		// One xlSet for each column of adjacent blocks with the same width.
+		std::stable_sort(values.begin(), values.end(), [](const block& a, const block& b) {
+			return a.ref.colFirst < b.ref.colFirst || (a.ref.colFirst == b.ref.colFirst && a.ref.rwFirst < b.ref.rwFirst);
+		});
+		for (size_t i = 0; i < values.size();) {
+			REF ref = values[i].ref;
+			OPER val = std::move(values[i].value);
+			for (++i; i < values.size(); ++i) {
+				const REF& r = values[i].ref;
+				if (r.colFirst != ref.colFirst || r.colLast != ref.colLast || r.rwFirst != ref.rwLast + 1) {
+					break;
+				}
+				val.vstack(std::move(values[i].value));
+				ref.rwLast = r.rwLast;
+			}
+			Excel(xlSet, OPER(ref), val);
+			++calls;
+		}
+		// Names are defined before formulas refer to them.
+		for (const auto& [name, ref] : names) {
+			Excel(xlcDefineName, name, OPER(ref), Missing, Missing, Missing, Missing, true);
+			++calls;
+		}
+		for (const auto& [ref, val] : formulas) {
+			Excel(xlcFormula, val, OPER(ref));
+			++calls;
+		}
+		for (const auto& g : formats) {
+			select(g.refs);
+			g.f();
+			calls += g.n;
+		}
+		for (const auto& [style, refs] : styles) {
+			select(refs);
+			Excel(xlcApplyStyle, style);
+			++calls;
+		}
+		if (selection) {
+			Excel(xlcSelect, OPER(selection));
+			++calls;
+			selection = REF{};
+		}
+		values.clear();
+		formulas.clear();
+		names.clear();
+		formats.clear();
+		styles.clear();
+	}
+};
+
+// Excel calls made by the last paste and calls saved by batching.
+static int paste_calls = 0, paste_saved = 0;
+AddIn xai_paste_calls(
+	Function(XLL_LPOPER, L"xll_paste_calls", L"XLL.PASTE.CALLS")
+	.Arguments({})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return Excel calls made by the last XLL.PASTEC or XLL.PASTED and the number saved by batching.")
+);
+LPOPER WINAPI xll_paste_calls()
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	o = OPER({ OPER(L"calls"), OPER(paste_calls), OPER(L"saved"), OPER(paste_saved) });
+	o.resize(2, 2);
+
+	return &o;
 }
 
 // Paste function with default arguments.
@@ -137,6 +345,19 @@ int WINAPI xll_pasteb()
 }
 On<xlcOnKey> xok_pasteb(ON_CTRL ON_SHIFT "B", "XLL.PASTEB");
 
+// Right aligned italic function name.
+void FormatCaller()
+{
+	AlignHorizontalRight();
+	FormatFont().Italic();
+}
+// Right aligned bold argument name.
+void FormatName()
+{
+	AlignHorizontalRight();
+	FormatFont().Bold();
+}
+
 // Paste function with default arguments below.
 AddIn xai_pastec(
 	Macro("xll_pastec", "XLL.PASTEC")
@@ -147,15 +368,18 @@ int WINAPI xll_pastec()
 	int result = TRUE;
 
 	try {
-		OPER caller = Excel(xlfActiveCell);
-		OPER text = Excel(xlCoerce, caller);
+		const REF caller = Active();
+		OPER text = Excel(xlCoerce, OPER(caller));
 		const Args* pargs = AddIn::find(text);
 		ensure (pargs || !"xll_pastec: add-in not found");
 		text = pargs->functionText;
 
+		Paste paste;
 		// Expand caller to size of formula output.
-		OPER output = Reshape(caller, Excel(xlfEvaluate, Formula(pargs)));
-		OPER active = Move(caller, rows(output), 0);
+		const OPER eval = Excel(xlfEvaluate, Formula(pargs));
+		const REF output = reshape(caller, rows(eval), columns(eval));
+		REF active = REF(caller.rwFirst + rows(output), caller.colFirst);
+		paste.move();
 
 		OPER formula = OPER(L"=") & text & OPER(L"(");
 		OPER comma(L"");
@@ -163,25 +387,30 @@ int WINAPI xll_pastec()
 			formula &= comma;
 
 			if (isNil(pargs->argumentInit[i])) {
-				formula &= Excel(xlfRelref, active, caller);
-				active = Move(active, 1, 0);
+				formula &= paste.relref(active, caller);
+				active = translate(active, 1, 0);
 			}
 			else {
-				const OPER ref = Set(active, pargs->argumentInit[i]);
-				formula &= Excel(xlfRelref, Reshape(active, ref), caller);
-				active = Move(active, rows(ref), 0);
+				const REF ref = paste.value(active, pargs->argumentInit[i]);
+				formula &= paste.relref(ref, caller);
+				active = translate(active, rows(ref), 0);
 			}
+			paste.move();
 
 			comma = L", ";
 		}
 		formula &= OPER(L")");
 
-		Excel(xlcFormula, formula, output);
-		Excel(xlcSelect, output);
+		paste.formula(output, formula);
 		if (isHandle(text)) {
-			Excel(xlcApplyStyle, L"Handle");
+			paste.style(output, OPER(L"Handle"));
 		}
-//		Excel(xlcApplyStyle, isHandle(text) ? L"Handle" : L"Output");
+		else {
+			paste.select(output);
+		}
+		paste.apply();
+		paste_calls = paste.calls;
+		paste_saved = paste.cells - paste.calls;
 	}
 	catch (const std::exception& ex) {
 		result = FALSE;
@@ -206,21 +435,24 @@ int WINAPI xll_pasted()
 	int result = TRUE;
 
 	try {
-		OPER caller = Excel(xlfActiveCell);
-		OPER text = Excel(xlCoerce, caller);
+		const REF caller = Active();
+		OPER text = Excel(xlCoerce, OPER(caller));
 		const Args* pargs = AddIn::find(text);
 		ensure(pargs || !"xll_pasted: add-in not found");
 		text = pargs->functionText;
 
-		Excel(xlSet, caller, text);
-		AlignHorizontalRight();
-		FormatFont().Italic();
+		Paste paste;
+		paste.value(caller, text);
+		paste.format(caller, FormatCaller, 2);
 
 		// Format handle.
-		OPER output = Reshape(Move(caller, 0, 1), Excel(xlfEvaluate, Formula(pargs)));
+		const OPER eval = Excel(xlfEvaluate, Formula(pargs));
+		const REF output = reshape(translate(caller, 0, 1), rows(eval), columns(eval));
+		paste.move();
 
 		// Expand caller to size of formula output.
-		OPER active = Move(caller, rows(output), 0);
+		REF active = REF(caller.rwFirst + rows(output), caller.colFirst);
+		paste.move();
 
 		OPER formula = OPER(L"=") & text & OPER(L"(");
 		OPER comma(L"");
@@ -228,31 +460,33 @@ int WINAPI xll_pasted()
 			formula &= comma;
 			const OPER& name = pargs->argumentName[i];
 			formula &= name;
-			Set(active, name);
-			AlignHorizontalRight();
-			FormatFont().Bold();
+			paste.value(active, name);
+			paste.format(active, FormatName, 2);
 
-			active = Move(active, 0, 1);
+			const REF cell = translate(active, 0, 1);
+			paste.move();
 			if (isNil(pargs->argumentInit[i])) {
-				Excel(xlcDefineName, name, active, Missing, Missing, Missing, Missing, true);
-				Excel(xlcApplyStyle, L"Input");
-				active = Move(active, 1, -1);
+				paste.name(name, cell);
+				paste.style(cell, OPER(L"Input"));
+				active = translate(active, 1, 0);
 			}
 			else {
-				const auto ref = Set(active, pargs->argumentInit[i]);
-				Excel(xlcDefineName, name, ref, Missing, Missing, Missing, Missing, true);
-				Excel(xlcSelect, ref);
-				Excel(xlcApplyStyle, L"Input");
-				active = Move(active, rows(ref), -1);
+				const REF ref = paste.value(cell, pargs->argumentInit[i]);
+				paste.name(name, ref);
+				paste.style(ref, OPER(L"Input"));
+				active = translate(active, rows(ref), 0);
 			}
+			paste.move();
 
 			comma = L", ";
 		}
 		formula &= OPER(L")");
 
-		Excel(xlcFormula, formula, output);
-		Excel(xlcSelect, output);
-		Excel(xlcApplyStyle, isHandle(text) ? L"Handle" : L"Output");
+		paste.formula(output, formula);
+		paste.style(output, OPER(isHandle(text) ? L"Handle" : L"Output"));
+		paste.apply();
+		paste_calls = paste.calls;
+		paste_saved = paste.cells - paste.calls;
 	}
 	catch (const std::exception& ex) {
 		result = FALSE;
@@ -2,7 +2,6 @@
 // https://docs.python.org/3/library/ctypes.html
 // The macro `PY` generates a Python module for import.
 #include <fstream>
-#include <map>
 #include "xll.h"
 
 using namespace xll;
@@ -103,7 +102,7 @@ OPER._fields_ = [
 namespace py {
 
 	// Excel to Python types.
-	inline std::map<xll::OPER, std::wstring> ctype = {
+	inline xll::oper_map<std::wstring> ctype = {
 	#define PY_ARG_CTYPE(T, A, B, C, D) { xll::OPER(L#B), L#C },
 		PY_ARG_TYPE(PY_ARG_CTYPE)
 	#undef PY_ARG_CTYPE
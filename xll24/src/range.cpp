@@ -55,4 +55,57 @@ LPXLOPER12 WINAPI xll_range_get(HANDLEX h)
 	}
 
 	return const_cast<LPXLOPER12>(&ErrNA);
-}
\ No newline at end of file
+}
+
+AddIn xai_range_index(
+	Function(XLL_HANDLEX, L"xll_range_index", L"\\RANGE.INDEX")
+	.Arguments({
+		Arg(XLL_LPOPER, L"Range", L"is a range with keys and values in two rows or two columns.", "={\"a\",1;\"b\",2}")
+		})
+	.Uncalced()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return a handle to an index of the keys of a range.")
+);
+HANDLEX WINAPI xll_range_index(LPOPER pr)
+{
+#pragma XLLEXPORT
+	HANDLEX result = INVALID_HANDLEX;
+
+	try {
+		handle<key_index> h(new key_index(*pr));
+		result = h.get();
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+	}
+
+	return result;
+}
+
+AddIn xai_range_index_lookup(
+	Function(XLL_LPOPER, L"xll_range_index_lookup", L"RANGE.INDEX.LOOKUP")
+	.Arguments({
+		Arg(XLL_HANDLEX, L"handle", L"is a handle returned by \\RANGE.INDEX."),
+		Arg(XLL_LPOPER, L"keys", L"is a key or range of keys."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return values corresponding to keys. Missing keys return #VALUE!.")
+);
+LPOPER WINAPI xll_range_index_lookup(HANDLEX h, LPOPER pkeys)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		handle<key_index> h_(h);
+		ensure(h_ || !"RANGE.INDEX.LOOKUP: invalid handle");
+		o = h_->values(*pkeys);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrNA;
+	}
+
+	return &o;
+}
@@ -0,0 +1,171 @@
+// simd.cpp - Vectorized reductions of arrays of numbers.
+// Functions are thread safe. Array results are written to per thread return buffers.
+// Size mismatches return NaN, a 1 x 1 array for array results, that Excel shows as #NUM!.
+// Alerts are not allowed from calculation threads.
+#include "xll.h"
+#include "simd.h"
+
+using namespace xll;
+
+AddIn xai_fp_sum(
+	Function(XLL_DOUBLE, L"xll_fp_sum", L"FP.SUM")
+	.Arguments({
+		Arg(XLL_FP, L"array", L"is an array of numbers.", "={1,2,3}"),
+		Arg(XLL_BOOL, L"_compensated", L"is an optional boolean indicating Kahan summation. Default is FALSE."),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the sum of array.")
+);
+double WINAPI xll_fp_sum(_FP12* pa, BOOL compensated)
+{
+#pragma XLLEXPORT
+	return compensated ? simd::sum_kahan(span(*pa)) : simd::sum(span(*pa));
+}
+
+AddIn xai_fp_dot(
+	Function(XLL_DOUBLE, L"xll_fp_dot", L"FP.DOT")
+	.Arguments({
+		Arg(XLL_FP, L"x", L"is an array of numbers.", "={1,2,3}"),
+		Arg(XLL_FP, L"y", L"is an array of numbers the same size as x.", "={4,5,6}"),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the sum of the products of x and y.")
+);
+double WINAPI xll_fp_dot(_FP12* px, _FP12* py)
+{
+#pragma XLLEXPORT
+	if (size(*px) != size(*py)) {
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+
+	return simd::dot(span(*px), span(*py));
+}
+
+AddIn xai_fp_min(
+	Function(XLL_DOUBLE, L"xll_fp_min", L"FP.MIN")
+	.Arguments({
+		Arg(XLL_FP, L"array", L"is an array of numbers.", "={3,1,2}"),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the smallest number in array.")
+);
+double WINAPI xll_fp_min(_FP12* pa)
+{
+#pragma XLLEXPORT
+	return simd::min(span(*pa));
+}
+
+AddIn xai_fp_max(
+	Function(XLL_DOUBLE, L"xll_fp_max", L"FP.MAX")
+	.Arguments({
+		Arg(XLL_FP, L"array", L"is an array of numbers.", "={3,1,2}"),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the largest number in array.")
+);
+double WINAPI xll_fp_max(_FP12* pa)
+{
+#pragma XLLEXPORT
+	return simd::max(span(*pa));
+}
+
+AddIn xai_fp_argmin(
+	Function(XLL_LPOPER, L"xll_fp_argmin", L"FP.ARGMIN")
+	.Arguments({
+		Arg(XLL_FP, L"array", L"is an array of numbers.", "={3,1,2}"),
+		Arg(XLL_BOOL, L"_max", L"is an optional boolean indicating the largest number. Default is FALSE."),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the one based index of the first smallest number in array or #N/A if there is none.")
+);
+LPOPER WINAPI xll_fp_argmin(_FP12* pa, BOOL max)
+{
+#pragma XLLEXPORT
+	OPER& o = return_buffer<OPER>();
+
+	const ptrdiff_t i = max ? simd::argmax(span(*pa)) : simd::argmin(span(*pa));
+	o = i == -1 ? OPER(ErrNA) : OPER(1. + i);
+
+	return &o;
+}
+
+AddIn xai_fp_mean(
+	Function(XLL_DOUBLE, L"xll_fp_mean", L"FP.MEAN")
+	.Arguments({
+		Arg(XLL_FP, L"array", L"is an array of numbers.", "={1,2,3}"),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the arithmetic mean of array.")
+);
+double WINAPI xll_fp_mean(_FP12* pa)
+{
+#pragma XLLEXPORT
+	return simd::mean(span(*pa));
+}
+
+AddIn xai_fp_variance(
+	Function(XLL_DOUBLE, L"xll_fp_variance", L"FP.VARIANCE")
+	.Arguments({
+		Arg(XLL_FP, L"array", L"is an array of numbers.", "={1,2,3}"),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the sample variance of array.")
+);
+double WINAPI xll_fp_variance(_FP12* pa)
+{
+#pragma XLLEXPORT
+	return simd::variance(span(*pa));
+}
+
+AddIn xai_fp_prefix(
+	Function(XLL_FP, L"xll_fp_prefix", L"FP.PREFIX")
+	.Arguments({
+		Arg(XLL_FP, L"array", L"is an array of numbers.", "={1,2,3}"),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return the running sums of array.")
+);
+_FP12* WINAPI xll_fp_prefix(_FP12* pa)
+{
+#pragma XLLEXPORT
+	FPX& r = return_fp(pa->rows, pa->columns);
+	simd::prefix(span(*pa), span(*r.get()));
+
+	return r.get();
+}
+
+AddIn xai_fp_axpy(
+	Function(XLL_FP, L"xll_fp_axpy", L"FP.AXPY")
+	.Arguments({
+		Arg(XLL_DOUBLE, L"a", L"is a number.", 2),
+		Arg(XLL_FP, L"x", L"is an array of numbers.", "={1,2,3}"),
+		Arg(XLL_FP, L"y", L"is an array of numbers the same size as x.", "={4,5,6}"),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return a x + y.")
+);
+_FP12* WINAPI xll_fp_axpy(double a, _FP12* px, _FP12* py)
+{
+#pragma XLLEXPORT
+	if (size(*px) != size(*py)) {
+		FPX& r = return_fp(1, 1);
+		r[0] = std::numeric_limits<double>::quiet_NaN();
+
+		return r.get();
+	}
+
+	FPX& r = return_fp(py->rows, py->columns);
+	std::copy_n(py->array, size(*py), r.array());
+	simd::axpy(a, span(*px), span(*r.get()));
+
+	return r.get();
+}
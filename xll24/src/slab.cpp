@@ -0,0 +1,33 @@
+// slab.cpp - Statistics of the per type slabs used by handles.
+#include "xll.h"
+
+using namespace xll;
+
+AddIn xai_slab_stats(
+	Function(XLL_LPOPER, L"xll_slab_stats", L"XLL.SLAB.STATS")
+	.Arguments({})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return a table of blocks allocated by each type derived from slab_allocated.")
+);
+LPOPER WINAPI xll_slab_stats()
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		o = OPER({ OPER(L"type"), OPER(L"size"), OPER(L"chunks"), OPER(L"capacity"),
+			OPER(L"in_use"), OPER(L"allocations"), OPER(L"frees") });
+		slab::for_each([](const slab_stats& s) {
+			OPER row({ OPER(s.name), OPER(1. * s.size), OPER(1. * s.chunks), OPER(1. * s.capacity),
+				OPER(1. * s.in_use), OPER(1. * s.allocations), OPER(1. * s.frees) });
+			o.vstack(row);
+		});
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
@@ -0,0 +1,95 @@
+// snapshot.cpp - Save handle objects when the add-in closes and map them when it opens.
+#include <filesystem>
+#include <string>
+#include "xll.h"
+
+using namespace xll;
+
+// Excel processes running the same xll use different files. The first process
+// takes instance 0 so a single Excel restores the snapshot of its last session.
+class snapshot_instance {
+	static constexpr int instances = 16;
+	HANDLE lock = INVALID_HANDLE_VALUE; // open without sharing until the xll is unloaded
+	std::filesystem::path path_;
+public:
+	snapshot_instance() = default;
+	snapshot_instance(const snapshot_instance&) = delete;
+	snapshot_instance& operator=(const snapshot_instance&) = delete;
+	~snapshot_instance()
+	{
+		if (lock != INVALID_HANDLE_VALUE) {
+			CloseHandle(lock);
+		}
+	}
+
+	// File in the temporary directory named after the xll and its full path. Empty if all are in use.
+	const std::filesystem::path& path()
+	{
+		if (lock != INVALID_HANDLE_VALUE) {
+			return path_;
+		}
+		const OPER name = Excel(xlGetName);
+		const std::filesystem::path xll(view(name));
+		std::wstring base = xll.stem().wstring();
+		base += L"." + std::to_wstring(hash(name) & 0xFFFFFFFF);
+		const auto dir = std::filesystem::temp_directory_path();
+		for (int i = 0; i < instances; ++i) {
+			const std::wstring file = base + L"." + std::to_wstring(i);
+			lock = CreateFileW((dir / (file + L".lock")).c_str(), GENERIC_WRITE, 0, nullptr,
+				OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+			if (lock != INVALID_HANDLE_VALUE) {
+				path_ = dir / (file + L".snapshot");
+
+				return path_;
+			}
+		}
+
+		return path_;
+	}
+};
+static snapshot_instance snapshot_file;
+
+// Files written by an older build of the same xll are not used.
+static uint64_t snapshot_build()
+{
+	const OPER name = Excel(xlGetName);
+	const std::filesystem::path xll(view(name));
+	const auto time = std::filesystem::last_write_time(xll).time_since_epoch().count();
+
+	return hash_combine(hash(name), hash_combine(static_cast<uint64_t>(time), std::filesystem::file_size(xll)));
+}
+
+bool xll::snapshot::enable()
+{
+	// Before any handles are created.
+	static Auto<Open> xao_snapshot([]() {
+		try {
+			const auto& path = snapshot_file.path();
+			if (!path.empty()) {
+				snapshot::instance().open(path, snapshot_build());
+			}
+		}
+		catch (const std::exception& ex) {
+			XLL_WARNING(ex.what());
+		}
+
+		return TRUE;
+	});
+	// A snapshot that cannot be written does not stop the add-in from closing.
+	// Excel can keep running the add-in if closing is canceled.
+	static Auto<Close> xac_snapshot([]() {
+		try {
+			const auto& path = snapshot_file.path();
+			if (!path.empty()) {
+				snapshot::instance().save(path);
+			}
+		}
+		catch (const std::exception& ex) {
+			XLL_WARNING(ex.what());
+		}
+
+		return TRUE;
+	});
+
+	return true;
+}
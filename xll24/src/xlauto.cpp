@@ -112,7 +112,8 @@ extern "C" void __declspec(dllexport) WINAPI
 xlAutoFree12(LPXLOPER12 px)
 {
 	XLL_TRACE;
-	if (px->xltype & xlbitDLLFree) {
+	// Pooled results keep their memory for the next call.
+	if ((px->xltype & xlbitDLLFree) && !dll_free_pool::instance().release(px)) {
 		px->xltype &= ~xlbitDLLFree;
 		static_cast<OPER*>(px)->~OPER();
 	}
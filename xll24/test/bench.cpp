@@ -0,0 +1,1415 @@
+// bench.cpp - Timing of OPER and FPX operations.
+// Copyright (c) KALX, LLC. All rights reserved. No warranty made.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <random>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "xll.h"
+#include "fp_expr.h"
+#include "parallel.h"
+#include "simd.h"
+
+using namespace xll;
+
+// Elapsed seconds to call f.
+template<class F>
+inline double seconds(F&& f)
+{
+	const auto t0 = std::chrono::steady_clock::now();
+	f();
+	const auto t1 = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double>(t1 - t0).count();
+}
+
+// vstack that allocates a new Multi and copies every element.
+OPER& vstack_copy(OPER& o, const OPER& x)
+{
+	if (size(o) == 0) {
+		return o = x;
+	}
+
+	OPER o_(rows(o) + rows(x), columns(o));
+	for (int i = 0; i < size(o); ++i) {
+		o_[i] = o[i];
+	}
+	for (int i = 0; i < size(x); ++i) {
+		o_[size(o) + i] = x[i];
+	}
+	std::swap(o, o_);
+
+	return o;
+}
+
+AddIn xai_bench_vstack(
+	Function(XLL_LPOPER, L"xll_bench_vstack", L"XLL.BENCH.VSTACK")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of rows to build. Default is 100000."),
+		Arg(XLL_BOOL, L"_full", L"is an optional boolean to also time copying n rows. Takes minutes for 100000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return rows n/100, n/10, n with seconds to build by copying and by OPER::vstack.")
+);
+LPOPER WINAPI xll_bench_vstack(LONG n, BOOL full)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 100000;
+		}
+		o = OPER({ OPER(L"rows"), OPER(L"copy"), OPER(L"vstack") });
+		for (LONG m : { n / 100, n / 10, n }) {
+			OPER a, b;
+			OPER copy = ErrNA;
+			if (m < n || full) {
+				copy = seconds([&]() {
+					for (LONG i = 0; i < m; ++i) {
+						vstack_copy(a, OPER(i));
+					}
+				});
+			}
+			double amortized = seconds([&]() {
+				for (LONG i = 0; i < m; ++i) {
+					b.vstack(OPER(i));
+				}
+			});
+			ensure(copy == ErrNA || a == b);
+			o.vstack(OPER({ OPER(m), copy, OPER(amortized) }));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// Arguments of a synthetic add-in function.
+static const struct { const wchar_t* type; const char* name; const char* help; } bench_args[] = {
+	{ XLL_DOUBLE, "x", "is the first number." },
+	{ XLL_DOUBLE, "y", "is the second number." },
+	{ XLL_LPOPER, "range", "is a range of cells." },
+	{ XLL_BOOL, "_flag", "is an optional boolean." },
+};
+
+// Registration arguments with a new buffer for every string.
+Args bench_args_copy(const std::wstring& name)
+{
+	Args args{ .procedure = OPER(name), .typeText = OPER(XLL_DOUBLE), .functionText = OPER(name), .macroType = OPER(1) };
+	OPER comma(L"");
+	for (const auto& arg : bench_args) {
+		args.typeText &= OPER(arg.type);
+		args.argumentText &= (comma & OPER(arg.name));
+		args.argumentType.append(OPER(arg.type));
+		args.argumentName.append(OPER(arg.name));
+		args.argumentHelp.append(OPER(arg.help));
+		args.argumentInit.append(OPER());
+		comma = OPER(L", ");
+	}
+	args.category = OPER(L"XLL");
+	args.functionHelp = OPER("Return a number.");
+
+	return args;
+}
+// Registration arguments using interned strings.
+Args bench_args_intern(const std::wstring& name)
+{
+	return Function(XLL_DOUBLE, name.c_str(), name.c_str())
+		.Arguments({
+			Arg(bench_args[0].type, bench_args[0].name, bench_args[0].help),
+			Arg(bench_args[1].type, bench_args[1].name, bench_args[1].help),
+			Arg(bench_args[2].type, bench_args[2].name, bench_args[2].help),
+			Arg(bench_args[3].type, bench_args[3].name, bench_args[3].help),
+			})
+		.Category(L"XLL")
+		.FunctionHelp("Return a number.");
+}
+// Distinct string buffers used by argument metadata.
+void bench_buffers(const Args& args, std::set<const XCHAR*>& bufs)
+{
+	bufs.insert(args.category.val.str);
+	for (const auto* po : { &args.argumentType, &args.argumentName, &args.argumentHelp }) {
+		for (const auto& o : *po) {
+			bufs.insert(o.val.str);
+		}
+	}
+}
+
+AddIn xai_bench_intern(
+	Function(XLL_LPOPER, L"xll_bench_intern", L"XLL.BENCH.INTERN")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of functions to create. Default is 5000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds and string buffers to create and copy arguments for n functions.")
+);
+LPOPER WINAPI xll_bench_intern(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 5000;
+		}
+		std::vector<std::wstring> names(n);
+		for (LONG i = 0; i < n; ++i) {
+			names[i] = L"BENCH.F" + std::to_wstring(i);
+		}
+
+		o = OPER({ OPER(L""), OPER(L"seconds"), OPER(L"buffers") });
+		using maker = Args(*)(const std::wstring&);
+		const std::pair<const wchar_t*, maker> makers[] = {
+			{ L"copy", bench_args_copy },
+			{ L"intern", bench_args_intern },
+		};
+		for (const auto& [label, make] : makers) {
+			// AddIn keeps a copy of the arguments.
+			std::vector<Args> args;
+			args.reserve(n);
+			double t = seconds([&]() {
+				for (LONG i = 0; i < n; ++i) {
+					args.emplace_back(make(names[i]));
+				}
+			});
+			std::set<const XCHAR*> bufs;
+			for (const auto& a : args) {
+				bench_buffers(a, bufs);
+			}
+			o.vstack(OPER({ OPER(label), OPER(t), OPER(static_cast<double>(bufs.size())) }));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+AddIn xai_bench_num(
+	Function(XLL_LPOPER, L"xll_bench_num", L"XLL.BENCH.NUM")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of OPERs to create and destroy. Default is 10000000."),
+		Arg(XLL_LONG, L"_handles", L"is the number of live nested handles. Default is 1000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return nanoseconds to create and destroy a numeric OPER with and without a handle lookup.")
+);
+LPOPER WINAPI xll_bench_num(LONG n, LONG m)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 10'000'000;
+		}
+		if (m <= 0) {
+			m = 1000;
+		}
+		// Populate the handle registry.
+		OPER nest(1, m);
+		for (auto& ni : nest) {
+			ni = OPER({ OPER(1), OPER(2) });
+		}
+		const OPER p = compress(nest);
+
+		double sum = 0;
+		// Destructors used to look up every number in the registry.
+		double lookup = seconds([&]() {
+			for (LONG i = 0; i < n; ++i) {
+				OPER x(i + 0.5);
+				sum += x.val.num;
+				if (handles::find(x.val.num)) {
+					sum += 1;
+				}
+			}
+		});
+		double plain = seconds([&]() {
+			for (LONG i = 0; i < n; ++i) {
+				OPER x(i + 0.5);
+				sum += x.val.num;
+			}
+		});
+		ensure(sum > 0);
+
+		o = OPER({ OPER(L"lookup"), OPER(1e9 * lookup / n), OPER(L"oper"), OPER(1e9 * plain / n) });
+		o.resize(2, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// Seconds to insert, find, churn, and erase n pointer keys.
+template<class M>
+std::vector<double> bench_pointer_ops(M& m, const std::vector<std::unique_ptr<double>>& ps, const std::vector<int>& churn)
+{
+	std::vector<double> t;
+	size_t hits = 0;
+
+	t.push_back(seconds([&]() {
+		for (const auto& p : ps) {
+			m.try_emplace(p.get(), "double");
+		}
+	}));
+	t.push_back(seconds([&]() {
+		for (const auto& p : ps) {
+			hits += m.contains(p.get());
+		}
+	}));
+	t.push_back(seconds([&]() {
+		for (int i : churn) {
+			m.erase(ps[i].get());
+			m.try_emplace(ps[i].get(), "double");
+		}
+	}));
+	t.push_back(seconds([&]() {
+		for (const auto& p : ps) {
+			m.erase(p.get());
+		}
+	}));
+	ensure(hits == ps.size() && m.size() == 0);
+
+	return t;
+}
+
+AddIn xai_bench_pointer_map(
+	Function(XLL_LPOPER, L"xll_bench_pointer_map", L"XLL.BENCH.POINTER_MAP")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of handles. Default is 200000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds for insert, find, churn and erase using std::map and pointer_map.")
+);
+LPOPER WINAPI xll_bench_pointer_map(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 200'000;
+		}
+		std::vector<std::unique_ptr<double>> ps(n);
+		for (auto& p : ps) {
+			p = std::make_unique<double>(0);
+		}
+		std::vector<int> churn(n);
+		std::minstd_rand r;
+		for (auto& i : churn) {
+			i = static_cast<int>(r() % n);
+		}
+
+		std::map<const void*, const char*> m;
+		pointer_map<const char*> pm;
+		const auto tm = bench_pointer_ops(m, ps, churn);
+		const auto tpm = bench_pointer_ops(pm, ps, churn);
+
+		o = OPER({ OPER(L""), OPER(L"std::map"), OPER(L"pointer_map") });
+		const wchar_t* op[] = { L"insert", L"find", L"churn", L"erase" };
+		for (size_t i = 0; i < tm.size(); ++i) {
+			o.vstack(OPER({ OPER(op[i]), OPER(tm[i]), OPER(tpm[i]) }));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// Lookups per second of threads finding every key in ps m times while another thread inserts and erases churn.
+template<class K, class Find, class Churn>
+double bench_lookup_threads(int threads, const std::vector<K>& ps, int m, Find find, Churn churn)
+{
+	std::atomic<bool> done = false;
+	std::atomic<size_t> hits = 0;
+	std::thread writer([&]() {
+		for (size_t i = 0; !done; ++i) {
+			churn(i);
+		}
+	});
+	const double t = seconds([&]() {
+		std::vector<std::thread> readers;
+		for (int k = 0; k < threads; ++k) {
+			readers.emplace_back([&]() {
+				size_t h = 0;
+				for (int j = 0; j < m; ++j) {
+					for (const auto& p : ps) {
+						h += find(p);
+					}
+				}
+				hits += h;
+			});
+		}
+		for (auto& r : readers) {
+			r.join();
+		}
+	});
+	done = true;
+	writer.join();
+	ensure(hits == threads * m * ps.size());
+
+	return hits / t;
+}
+
+// Excel entry point in XLCALL.CPP.
+typedef int (PASCAL* EXCEL12PROC)(int xlfn, int coper, LPXLOPER12* rgpxloper12, LPXLOPER12 xloper12Res);
+extern EXCEL12PROC pexcel12;
+
+// Row of the cell calling the stand-in for Excel on this thread.
+static thread_local int stand_in_row = 0;
+// Handles in the cells of the stand-in.
+static std::vector<HANDLEX> stand_in_cells;
+
+// Answers xlfCaller and xlCoerce instantly so timings show only the cost of the callback.
+int PASCAL stand_in_excel12(int xlfn, int, LPXLOPER12*, LPXLOPER12 res)
+{
+	if (xlfn == xlfCaller) {
+		res->xltype = xltypeSRef;
+		res->val.sref.count = 1;
+		res->val.sref.ref = XLREF12{ stand_in_row, stand_in_row, 0, 0 };
+	}
+	else if (xlfn == xlCoerce && stand_in_row < static_cast<int>(stand_in_cells.size())) {
+		res->xltype = xltypeNum;
+		res->val.num = stand_in_cells[stand_in_row];
+	}
+	else {
+		res->xltype = xltypeNil;
+	}
+
+	return xlretSuccess;
+}
+
+// Restore Excel on exit.
+struct stand_in {
+	EXCEL12PROC excel12 = pexcel12;
+	stand_in()
+	{
+		pexcel12 = stand_in_excel12;
+	}
+	~stand_in()
+	{
+		pexcel12 = excel12;
+		stand_in_cells.clear();
+	}
+};
+
+struct bench_handle_object {
+	double x;
+};
+
+AddIn xai_bench_handle_lookup(
+	Function(XLL_LPOPER, L"xll_bench_handle_lookup", L"XLL.BENCH.HANDLE.LOOKUP")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of handles. Default is 1000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return nanoseconds per handle lookup from another cell with and without an xlfCaller callback using a stand-in for Excel.")
+);
+LPOPER WINAPI xll_bench_handle_lookup(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 1000;
+		}
+		const int m = std::max(1, 10'000'000 / n);
+		stand_in excel;
+
+		// Create a handle in each of n cells.
+		stand_in_cells.assign(n, INVALID_HANDLEX);
+		for (int i = 0; i < n; ++i) {
+			stand_in_row = i;
+			handle<bench_handle_object> h(new bench_handle_object{ 1. * i });
+			stand_in_cells[i] = h.get();
+		}
+
+		// Look up from a cell below.
+		stand_in_row = n;
+		const OPER creator(REF(0, 0));
+		double sum = 0;
+		// Every lookup used to compare the caller to the cell that created the handle.
+		const double callback = seconds([&]() {
+			for (int j = 0; j < m; ++j) {
+				for (HANDLEX h : stand_in_cells) {
+					handle<bench_handle_object> h_(h);
+					if (Excel(xlfCaller) != creator) {
+						sum += h_->x;
+					}
+				}
+			}
+		});
+		const double lookup = seconds([&]() {
+			for (int j = 0; j < m; ++j) {
+				for (HANDLEX h : stand_in_cells) {
+					handle<bench_handle_object> h_(h);
+					sum += h_->x;
+				}
+			}
+		});
+		ensure(sum == m * (n - 1.) * n);
+
+		// Replace each handle and erase the replacement as a temporary.
+		for (int i = 0; i < n; ++i) {
+			stand_in_row = i;
+			HANDLEX h;
+			{
+				handle<bench_handle_object> h_(new bench_handle_object{ 0 });
+				h = h_.get();
+			}
+			handle<bench_handle_object> h_(h);
+			ensure(h_.is_temporary());
+		}
+
+		o = OPER({ OPER(L"callback"), OPER(1e9 * callback / (1. * m * n)), OPER(L"lookup"), OPER(1e9 * lookup / (1. * m * n)) });
+		o.resize(2, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+struct bench_slab_object : slab_allocated<bench_slab_object> {
+	double x;
+	bench_slab_object(double x)
+		: x(x)
+	{ }
+};
+
+// Seconds for m recalculations of a cell creating a handle to T.
+template<class T>
+static double bench_recalc(int m)
+{
+	stand_in_row = 0;
+	stand_in_cells.assign(1, INVALID_HANDLEX);
+	const double t = seconds([m]() {
+		for (int j = 0; j < m; ++j) {
+			handle<T> h(new T(1. * j));
+			stand_in_cells[0] = h.get();
+		}
+	});
+	// Erase the last handle as a temporary.
+	handle<T> h(stand_in_cells[0]);
+	ensure(h.is_temporary());
+
+	return t;
+}
+
+AddIn xai_bench_handle_slab(
+	Function(XLL_LPOPER, L"xll_bench_handle_slab", L"XLL.BENCH.HANDLE.SLAB")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of recalculations. Default is 1000000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return nanoseconds per recalculation of a cell creating a handle with and without a slab using a stand-in for Excel.")
+);
+LPOPER WINAPI xll_bench_handle_slab(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 1'000'000;
+		}
+		stand_in excel;
+
+		const double heap = bench_recalc<bench_handle_object>(n);
+		const slab_stats s0 = slab_of<bench_slab_object>().stats();
+		const double slab = bench_recalc<bench_slab_object>(n);
+		const slab_stats s1 = slab_of<bench_slab_object>().stats();
+		ensure(s1.in_use == s0.in_use);
+
+		o = OPER({ OPER(L"heap"), OPER(1e9 * heap / n), OPER(L"slab"), OPER(1e9 * slab / n),
+			OPER(L"chunks"), OPER(1. * s1.chunks) });
+		o.resize(3, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// Array returned by the stand-in for Excel. Half numbers and half strings.
+static std::vector<XLOPER12> stand_in_result;
+static XCHAR stand_in_str[] = L"\011stand in!";
+
+// Returns stand_in_result with xlbitXLFree set. xlFree does nothing.
+int PASCAL stand_in_excel12_result(int xlfn, int, LPXLOPER12*, LPXLOPER12 res)
+{
+	if (xlfn != xlFree) {
+		res->xltype = xltypeMulti | xlbitXLFree;
+		res->val.array.lparray = stand_in_result.data();
+		res->val.array.rows = 1;
+		res->val.array.columns = static_cast<int>(stand_in_result.size());
+	}
+
+	return xlretSuccess;
+}
+
+AddIn xai_bench_excel_result(
+	Function(XLL_LPOPER, L"xll_bench_excel_result", L"XLL.BENCH.EXCEL.RESULT")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of items in the result. Default is 10000."),
+		Arg(XLL_LONG, L"calls", L"is the number of calls to time. Default is 1000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return nanoseconds per item for Excel() to copy an array result and free it, and for the call and xlFree alone, using a stand-in for Excel.")
+);
+LPOPER WINAPI xll_bench_excel_result(LONG n, LONG calls)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 10'000;
+		}
+		if (calls <= 0) {
+			calls = 1'000;
+		}
+		stand_in_result.resize(n);
+		for (int i = 0; i < n; ++i) {
+			stand_in_result[i] = (i % 2) ? XLOPER12{ .val = { .str = stand_in_str }, .xltype = xltypeStr } : Num(i);
+		}
+		struct restore {
+			EXCEL12PROC excel12 = pexcel12;
+			~restore()
+			{
+				pexcel12 = excel12;
+			}
+		} restore_;
+		pexcel12 = stand_in_excel12_result;
+
+		double items = 0;
+		const double call = seconds([&]() {
+			for (int k = 0; k < calls; ++k) {
+				XLOPER12 res;
+				ensure_ret(::Excel12v(xlfEvaluate, &res, 0, nullptr));
+				items += size(res);
+				::Excel12(xlFree, 0, 1, &res);
+			}
+		});
+		const double copy = seconds([&]() {
+			for (int k = 0; k < calls; ++k) {
+				items += size(Excel(xlfEvaluate));
+			}
+		});
+		ensure(items == 2. * n * calls);
+
+		o = OPER({ OPER(L"call"), OPER(1e9 * call / (1. * n * calls)), OPER(L"copy"), OPER(1e9 * copy / (1. * n * calls)) });
+		o.resize(2, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// Discount curve fitted to par rates as a stand-in for an expensive constructor.
+struct bench_curve {
+	std::vector<double> d;
+
+	bench_curve() = default;
+	bench_curve(double r, int n)
+		: d(n)
+	{
+		// Bootstrap annual par bonds with coupon r + 0.001 k.
+		double annuity = 0;
+		for (int k = 0; k < n; ++k) {
+			const double c = r + 0.001 * k;
+			double f = std::exp(-c * (k + 1));
+			// Newton on c annuity + (1 + c) f = 1.
+			for (int j = 0; j < 8; ++j) {
+				f -= (c * annuity + (1 + c) * f - 1) / (1 + c);
+			}
+			d[k] = f;
+			annuity += f;
+		}
+	}
+};
+template<>
+struct xll::serialize<bench_curve> {
+	static void write(snapshot_writer& w, const bench_curve& c)
+	{
+		w.put<uint32_t>(static_cast<uint32_t>(c.d.size()));
+		w.put(c.d.data(), c.d.size() * sizeof(double));
+	}
+	static bench_curve* read(snapshot_reader& r)
+	{
+		auto c = new bench_curve;
+		c->d.resize(r.get<uint32_t>());
+		r.get(c->d.data(), c->d.size() * sizeof(double));
+
+		return c;
+	}
+};
+
+AddIn xai_bench_handle_snapshot(
+	Function(XLL_LPOPER, L"xll_bench_handle_snapshot", L"XLL.BENCH.HANDLE.SNAPSHOT")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of objects. Default is 10000."),
+		Arg(XLL_LONG, L"_points", L"is the number of points on each curve. Default is 100."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return nanoseconds per object to construct, save, find, and read curves from a snapshot.")
+);
+LPOPER WINAPI xll_bench_handle_snapshot(LONG n, LONG points)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 10'000;
+		}
+		if (points <= 0) {
+			points = 100;
+		}
+		const uint64_t type = snapshot_type<bench_curve>();
+		const uint32_t version = serialize_version<bench_curve>();
+		auto rate = [](int i) { return 0.01 + 1e-6 * i; };
+
+		std::vector<std::unique_ptr<bench_curve>> cs(n);
+		const double construct = seconds([&]() {
+			for (int i = 0; i < n; ++i) {
+				cs[i] = std::make_unique<bench_curve>(rate(i), points);
+			}
+		});
+
+		snapshot::out out;
+		const double save = seconds([&]() {
+			for (int i = 0; i < n; ++i) {
+				out.add(type, snapshot_key(rate(i), points).value(), version, [&c = *cs[i]](snapshot_writer& w) {
+					serialize<bench_curve>::write(w, c);
+				});
+			}
+		});
+
+		// Creating a handle only finds the entry. It is read when first used.
+		snapshot s;
+		std::vector<uint64_t> offs(n);
+		const double find = seconds([&]() {
+			ensure(s.attach(out.data()));
+			for (int i = 0; i < n; ++i) {
+				offs[i] = s.find(type, snapshot_key(rate(i), points).value(), version);
+			}
+		});
+		const double read = seconds([&]() {
+			for (int i = 0; i < n; ++i) {
+				cs[i].reset(s.read<bench_curve>(offs[i]));
+			}
+		});
+		ensure(cs[n - 1]->d == bench_curve(rate(n - 1), points).d);
+
+		o = OPER({ OPER(L"construct"), OPER(1e9 * construct / n), OPER(L"save"), OPER(1e9 * save / n),
+			OPER(L"find"), OPER(1e9 * find / n), OPER(L"read"), OPER(1e9 * read / n) });
+		o.resize(4, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+AddIn xai_bench_handle_threads(
+	Function(XLL_LPOPER, L"xll_bench_handle_threads", L"XLL.BENCH.HANDLE.THREADS")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of handles. Default is 10000."),
+		Arg(XLL_LONG, L"_threads", L"is the largest number of reading threads. Default is 8."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return millions of handle lookups per second by number of threads while handles are created and destroyed using a stand-in for Excel.")
+);
+LPOPER WINAPI xll_bench_handle_threads(LONG n, LONG threads)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 10'000;
+		}
+		if (threads <= 0) {
+			threads = 8;
+		}
+		std::vector<std::unique_ptr<double>> ps_(n), churn(1000);
+		std::vector<const void*> ps;
+		for (auto& p : ps_) {
+			p = std::make_unique<double>(0);
+			ps.push_back(p.get());
+		}
+		for (auto& p : churn) {
+			p = std::make_unique<double>(0);
+		}
+		const int m = std::max(1, 10'000'000 / n);
+
+		concurrent_pointer_map<uint64_t> cm;
+		pointer_map<uint64_t> pm;
+		std::mutex mm;
+		std::shared_mutex sm;
+		for (const void* p : ps) {
+			cm.insert(p, 1);
+			pm.try_emplace(p, 1);
+		}
+		// Handles in churn are created and destroyed like a recalculating creator cell.
+		auto toggle = [&](auto& insert, auto& erase, size_t i) {
+			const void* p = churn[i % churn.size()].get();
+			erase(p) || insert(p);
+		};
+
+		// Handles in rows [0, n) are looked up and rows after them recalculate.
+		stand_in excel;
+		stand_in_cells.assign(n + churn.size(), INVALID_HANDLEX);
+		for (int i = 0; i < n; ++i) {
+			stand_in_row = i;
+			handle<bench_handle_object> h(new bench_handle_object{ 1. * i });
+			stand_in_cells[i] = h.get();
+		}
+		const std::vector<HANDLEX> hs(stand_in_cells.begin(), stand_in_cells.begin() + n);
+		// Only the recalculating thread writes cells after the first n.
+		auto recalc = [&](size_t i) {
+			stand_in_row = n + static_cast<int>(i % churn.size());
+			handle<bench_handle_object> h(new bench_handle_object{ 1. * i });
+			stand_in_cells[stand_in_row] = h.get();
+		};
+
+		o = OPER({ OPER(L"threads"), OPER(L"handle"), OPER(L"concurrent_pointer_map"), OPER(L"shared_mutex"), OPER(L"mutex") });
+		for (int k = 1; k <= threads; k *= 2) {
+			const double lookup = bench_lookup_threads(k, hs, m,
+				[](HANDLEX h) { handle<bench_handle_object> h_(h); return h_ ? 1 : 0; }, recalc);
+
+			auto cm_insert = [&](const void* p) { return cm.insert(p, 1); };
+			auto cm_erase = [&](const void* p) { return cm.erase(p); };
+			const double wait_free = bench_lookup_threads(k, ps, m,
+				[&](const void* p) { return cm.contains(p); },
+				[&](size_t i) { toggle(cm_insert, cm_erase, i); });
+
+			auto pm_insert = [&](const void* p) { return pm.try_emplace(p, 1).second; };
+			auto pm_erase = [&](const void* p) { return pm.erase(p); };
+			const double shared = bench_lookup_threads(k, ps, m,
+				[&](const void* p) { std::shared_lock lock(sm); return pm.contains(p); },
+				[&](size_t i) { std::unique_lock lock(sm); toggle(pm_insert, pm_erase, i); });
+			const double exclusive = bench_lookup_threads(k, ps, m,
+				[&](const void* p) { std::lock_guard lock(mm); return pm.contains(p); },
+				[&](size_t i) { std::lock_guard lock(mm); toggle(pm_insert, pm_erase, i); });
+
+			o.vstack(OPER({ OPER(1. * k), OPER(lookup / 1e6), OPER(wait_free / 1e6), OPER(shared / 1e6), OPER(exclusive / 1e6) }));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// Seconds to insert and find OPER keys.
+template<class M>
+std::vector<double> bench_oper_ops(M& m, const std::vector<OPER>& keys)
+{
+	std::vector<double> t;
+	size_t hits = 0;
+
+	t.push_back(seconds([&]() {
+		for (size_t i = 0; i < keys.size(); ++i) {
+			m.emplace(keys[i], static_cast<int>(i));
+		}
+	}));
+	t.push_back(seconds([&]() {
+		for (const auto& k : keys) {
+			hits += m.find(k) != m.end();
+		}
+	}));
+	ensure(hits == keys.size());
+
+	return t;
+}
+
+AddIn xai_bench_oper_map(
+	Function(XLL_LPOPER, L"xll_bench_oper_map", L"XLL.BENCH.OPER_MAP")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of keys. Default is 100000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds for insert and find of string and number keys using std::map and oper_map.")
+);
+LPOPER WINAPI xll_bench_oper_map(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 100'000;
+		}
+		std::vector<OPER> keys(n);
+		for (LONG i = 0; i < n; ++i) {
+			keys[i] = i % 2 ? OPER(L"key" + std::to_wstring(i)) : OPER(i + 0.5);
+		}
+		std::shuffle(keys.begin(), keys.end(), std::minstd_rand{});
+
+		std::map<OPER, int> m;
+		oper_map<int> um;
+		const auto tm = bench_oper_ops(m, keys);
+		const auto tum = bench_oper_ops(um, keys);
+
+		o = OPER({ OPER(L""), OPER(L"std::map"), OPER(L"oper_map") });
+		const wchar_t* op[] = { L"insert", L"find" };
+		for (size_t i = 0; i < tm.size(); ++i) {
+			o.vstack(OPER({ OPER(op[i]), OPER(tm[i]), OPER(tum[i]) }));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+AddIn xai_bench_key_index(
+	Function(XLL_LPOPER, L"xll_bench_key_index", L"XLL.BENCH.KEY_INDEX")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of keys in a two column dictionary. Default is 20000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds to look up every key with xll::lookup and with key_index.")
+);
+LPOPER WINAPI xll_bench_key_index(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 20'000;
+		}
+		OPER d(n, 2);
+		for (LONG i = 0; i < n; ++i) {
+			d(i, 0) = OPER(L"key" + std::to_wstring(i));
+			d(i, 1) = OPER(1. * i);
+		}
+
+		int sum = 0;
+		double linear = seconds([&]() {
+			for (LONG i = 0; i < n; ++i) {
+				sum += lookup(d, d(i, 0));
+			}
+		});
+		std::unique_ptr<key_index> ki;
+		double build = seconds([&]() {
+			ki = std::make_unique<key_index>(d);
+		});
+		double indexed = seconds([&]() {
+			for (LONG i = 0; i < n; ++i) {
+				sum -= ki->lookup(d(i, 0));
+			}
+		});
+		ensure(sum == 0);
+
+		o = OPER({ OPER(L"lookup"), OPER(linear), OPER(L"build"), OPER(build), OPER(L"key_index"), OPER(indexed) });
+		o.resize(3, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// Transpose through a full copy scattering with a modulo per element.
+void transpose_modulo(FPX& a)
+{
+	const int64_t r = rows(a);
+	const int64_t c = columns(a);
+	const int64_t n = r * c;
+	if (r > 1 && c > 1) {
+		const FPX a_(a);
+		for (int64_t k = 1; k < n - 1; ++k) {
+			a[static_cast<int>((r * k) % (n - 1))] = a_[static_cast<int>(k)];
+		}
+	}
+	a.resize(static_cast<int>(c), static_cast<int>(r));
+}
+
+AddIn xai_bench_transpose(
+	Function(XLL_LPOPER, L"xll_bench_transpose", L"XLL.BENCH.TRANSPOSE")
+	.Arguments({})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds to transpose FP12 arrays of several shapes with a modulo scatter and with fpx_transpose.")
+);
+LPOPER WINAPI xll_bench_transpose()
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		o = OPER({ OPER(L"rows"), OPER(L"columns"), OPER(L"modulo"), OPER(L"fpx_transpose") });
+		// Square, multiple, and general shapes where neither side divides the other.
+		const int shape[][2] = { {2000, 2000}, {1000, 4000}, {4000, 1000}, {1999, 2001}, {2001, 1999}, {1001, 999}, {500, 7919}, {3, 1'000'001} };
+		for (const auto [r, c] : shape) {
+			FPX a(r, c);
+			for (int k = 0; k < a.size(); ++k) {
+				a[k] = k;
+			}
+			FPX b(a);
+			double modulo = seconds([&]() { transpose_modulo(a); });
+			double blocked = seconds([&]() { b.transpose(); });
+			ensure(a == b);
+			o.vstack(OPER({ OPER(r), OPER(c), OPER(modulo), OPER(blocked) }));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+AddIn xai_bench_append(
+	Function(XLL_LPOPER, L"xll_bench_append", L"XLL.BENCH.APPEND")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of doubles to append. Default is 1000000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds to append n doubles to an FPX reallocating every time and growing geometrically.")
+);
+LPOPER WINAPI xll_bench_append(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 1'000'000;
+		}
+		FPX a, b;
+		// Reallocate to the exact size like append used to.
+		double exact = seconds([&]() {
+			for (LONG i = 0; i < n; ++i) {
+				a.append(i).shrink_to_fit();
+			}
+		});
+		double geometric = seconds([&]() {
+			for (LONG i = 0; i < n; ++i) {
+				b.append(i);
+			}
+		});
+		ensure(a == b);
+
+		o = OPER({ OPER(L"exact"), OPER(exact), OPER(L"geometric"), OPER(geometric) });
+		o.resize(2, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// hstack by transposing, vstacking and transposing back.
+FPX& hstack_transpose(FPX& a, const FPX& b)
+{
+	FPX a_(a);
+	a_.transpose();
+	FPX _b(b);
+	_b.transpose();
+	a_.vstack(_b);
+	a_.transpose();
+	a.swap(a_);
+
+	return a;
+}
+
+AddIn xai_bench_hstack(
+	Function(XLL_LPOPER, L"xll_bench_hstack", L"XLL.BENCH.HSTACK")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of 1000 x 20 arrays to hstack. Default is 50."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds to hstack n arrays using transposes, FPX::hstack, and one multi-way hstack.")
+);
+LPOPER WINAPI xll_bench_hstack(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 50;
+		}
+		std::vector<FPX> as(n, FPX(1000, 20));
+		for (LONG k = 0; k < n; ++k) {
+			for (int i = 0; i < as[k].size(); ++i) {
+				as[k][i] = k + i;
+			}
+		}
+
+		FPX a, b, c;
+		double transposes = seconds([&]() {
+			a = as[0];
+			for (LONG k = 1; k < n; ++k) {
+				hstack_transpose(a, as[k]);
+			}
+		});
+		double pairwise = seconds([&]() {
+			for (const auto& ak : as) {
+				b.hstack(ak);
+			}
+		});
+		double multiway = seconds([&]() {
+			std::vector<const _FP12*> ps;
+			for (const auto& ak : as) {
+				ps.push_back(ak.get());
+			}
+			c = hstack(ps);
+		});
+		ensure(a == b && b == c);
+
+		o = OPER({ OPER(L"transposes"), OPER(transposes), OPER(L"hstack"), OPER(pairwise), OPER(L"multi-way"), OPER(multiway) });
+		o.resize(3, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+AddIn xai_bench_simd(
+	Function(XLL_LPOPER, L"xll_bench_simd", L"XLL.BENCH.SIMD")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of doubles. Default is 1000000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds for 100 sums, dots, argmins and prefix sums of n doubles using the standard library and each instruction set.")
+);
+LPOPER WINAPI xll_bench_simd(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 1'000'000;
+		}
+		constexpr int m = 100;
+		std::vector<double> x(n), y(n), z(n);
+		std::mt19937 g(1);
+		std::uniform_real_distribution<double> u(-1, 1);
+		for (LONG i = 0; i < n; ++i) {
+			x[i] = u(g);
+			y[i] = u(g);
+		}
+		volatile double s = 0;
+
+		o = OPER({ OPER(L""), OPER(L"sum"), OPER(L"dot"), OPER(L"argmin"), OPER(L"prefix") });
+		o.vstack(OPER({
+			OPER(L"std"),
+			OPER(seconds([&]() { for (int k = 0; k < m; ++k) s = std::accumulate(x.begin(), x.end(), 0.); })),
+			OPER(seconds([&]() { for (int k = 0; k < m; ++k) s = std::inner_product(x.begin(), x.end(), y.begin(), 0.); })),
+			OPER(seconds([&]() { for (int k = 0; k < m; ++k) s = static_cast<double>(std::min_element(x.begin(), x.end()) - x.begin()); })),
+			OPER(seconds([&]() { for (int k = 0; k < m; ++k) std::partial_sum(x.begin(), x.end(), z.begin()); })),
+			}));
+		const wchar_t* name[] = { L"scalar", L"sse2", L"avx2", L"avx512" };
+		for (auto i : { simd::isa::scalar, simd::isa::sse2, simd::isa::avx2, simd::isa::avx512 }) {
+			const auto& k = simd::kernels(i);
+			if (k.level != i) {
+				o.vstack(OPER({ OPER(name[static_cast<int>(i)]), OPER(ErrNA), OPER(ErrNA), OPER(ErrNA), OPER(ErrNA) }));
+				continue;
+			}
+			o.vstack(OPER({
+				OPER(name[static_cast<int>(i)]),
+				OPER(seconds([&]() { for (int j = 0; j < m; ++j) s = k.sum(x.data(), n); })),
+				OPER(seconds([&]() { for (int j = 0; j < m; ++j) s = k.dot(x.data(), y.data(), n); })),
+				OPER(seconds([&]() { for (int j = 0; j < m; ++j) s = static_cast<double>(k.argmin(x.data(), n)); })),
+				OPER(seconds([&]() { for (int j = 0; j < m; ++j) k.prefix(x.data(), z.data(), n); })),
+				}));
+		}
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+AddIn xai_bench_parallel(
+	Function(XLL_LPOPER, L"xll_bench_parallel", L"XLL.BENCH.PARALLEL")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of doubles. Default is 1000000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds to apply tgamma to n doubles in a loop and with parallel_transform, and the number of threads.")
+);
+LPOPER WINAPI xll_bench_parallel(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 1'000'000;
+		}
+		std::vector<double> x(n), y(n), z(n);
+		for (LONG i = 0; i < n; ++i) {
+			x[i] = 1 + 10. * i / n;
+		}
+		double serial = seconds([&]() {
+			for (LONG i = 0; i < n; ++i) {
+				y[i] = std::tgamma(x[i]);
+			}
+		});
+		double parallel = seconds([&]() {
+			parallel_transform(x, z, [](double xi) { return std::tgamma(xi); });
+		});
+		ensure(y == z);
+
+		o = OPER({
+			OPER(L"serial"), OPER(serial),
+			OPER(L"parallel"), OPER(parallel),
+			OPER(L"threads"), OPER(1. * thread_pool::instance().threads())
+			});
+		o.resize(3, 2);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+AddIn xai_bench_convert(
+	Function(XLL_LPOPER, L"xll_bench_convert", L"XLL.BENCH.CONVERT")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of rows of a 10 column array. Default is 100000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds to convert a Multi to FPX and back 10 times element by element and with to_fp and to_oper.")
+);
+LPOPER WINAPI xll_bench_convert(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 100'000;
+		}
+		OPER x(n, 10);
+		for (int i = 0; i < size(x); ++i) {
+			x[i] = 1. * i;
+		}
+
+		// Buffers are reused like a loader called every recalc.
+		constexpr int m = 10;
+		FPX a, b;
+		OPER y, z;
+		double loop_fp = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				a.resize(rows(x), columns(x));
+				for (int i = 0; i < size(x); ++i) {
+					a[i] = asNum(x[i]);
+				}
+			}
+		});
+		double bulk_fp = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				to_fp(x, b);
+			}
+		});
+		ensure(a == b);
+		double loop_oper = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				y.resize(rows(a), columns(a));
+				for (int i = 0; i < a.size(); ++i) {
+					y[i] = a[i];
+				}
+			}
+		});
+		double bulk_oper = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				to_oper(b, z);
+			}
+		});
+		ensure(y == z && z == x);
+
+		o = OPER({
+			OPER(L""), OPER(L"loop"), OPER(L"bulk"),
+			OPER(L"to FPX"), OPER(loop_fp), OPER(bulk_fp),
+			OPER(L"to OPER"), OPER(loop_oper), OPER(bulk_oper),
+			});
+		o.resize(3, 3);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
+
+// Element-wise operations that return a new array like a naive operator overload.
+FPX add_copy(const FPX& a, const FPX& b)
+{
+	FPX c(a.rows(), a.columns());
+	for (int i = 0; i < c.size(); ++i) {
+		c[i] = a[i] + b[i];
+	}
+
+	return c;
+}
+FPX mul_copy(const FPX& a, const FPX& b)
+{
+	FPX c(a.rows(), a.columns());
+	for (int i = 0; i < c.size(); ++i) {
+		c[i] = a[i] * b[i];
+	}
+
+	return c;
+}
+FPX sqrt_copy(const FPX& a)
+{
+	FPX c(a.rows(), a.columns());
+	for (int i = 0; i < c.size(); ++i) {
+		c[i] = std::sqrt(a[i]);
+	}
+
+	return c;
+}
+
+AddIn xai_bench_expr(
+	Function(XLL_LPOPER, L"xll_bench_expr", L"XLL.BENCH.EXPR")
+	.Arguments({
+		Arg(XLL_LONG, L"n", L"is the number of elements. Default is 1000000."),
+		})
+	.Category(L"XLL")
+	.FunctionHelp(L"Return seconds to compute a + b*c and sqrt(a*a + b*b) 10 times with temporaries, expression templates, and a hand written loop.")
+);
+LPOPER WINAPI xll_bench_expr(LONG n)
+{
+#pragma XLLEXPORT
+	static OPER o;
+
+	try {
+		if (n <= 0) {
+			n = 1'000'000;
+		}
+		FPX a(n, 1), b(n, 1), c(n, 1);
+		for (int i = 0; i < n; ++i) {
+			a[i] = 1. + i;
+			b[i] = 2. + i;
+			c[i] = 3. + i;
+		}
+
+		constexpr int m = 10;
+		FPX x, y, z;
+		double temp_axpy = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				x = add_copy(a, mul_copy(b, c));
+			}
+		});
+		double expr_axpy = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				y = a + b * c;
+			}
+		});
+		double loop_axpy = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				z.resize(n, 1);
+				for (int i = 0; i < n; ++i) {
+					z[i] = a[i] + b[i] * c[i];
+				}
+			}
+		});
+		ensure(x == y && y == z);
+
+		double temp_hypot = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				x = sqrt_copy(add_copy(mul_copy(a, a), mul_copy(b, b)));
+			}
+		});
+		double expr_hypot = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				y = sqrt(a * a + b * b);
+			}
+		});
+		double loop_hypot = seconds([&]() {
+			for (int k = 0; k < m; ++k) {
+				z.resize(n, 1);
+				for (int i = 0; i < n; ++i) {
+					z[i] = std::sqrt(a[i] * a[i] + b[i] * b[i]);
+				}
+			}
+		});
+		ensure(x == y && y == z);
+
+		o = OPER({
+			OPER(L""), OPER(L"temporaries"), OPER(L"expression"), OPER(L"loop"),
+			OPER(L"a + b*c"), OPER(temp_axpy), OPER(expr_axpy), OPER(loop_axpy),
+			OPER(L"sqrt(a*a + b*b)"), OPER(temp_hypot), OPER(expr_hypot), OPER(loop_hypot),
+			});
+		o.resize(3, 4);
+	}
+	catch (const std::exception& ex) {
+		XLL_ERROR(ex.what());
+
+		o = ErrValue;
+	}
+
+	return &o;
+}
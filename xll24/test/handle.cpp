@@ -150,6 +150,71 @@ LPOPER WINAPI xll_derived_get(HANDLEX _h)
 
 	return &o;
 }
+
+// value that never changes after it is created
+class constant {
+	const OPER x;
+public:
+	constant(const OPER& x)
+		: x(x)
+	{ }
+	const OPER& get() const
+	{
+		return x;
+	}
+};
+
+// save constant objects when the add-in closes
+template<>
+struct xll::serialize<constant> {
+	static void write(snapshot_writer& w, const constant& c)
+	{
+		w.put(c.get());
+	}
+	static constant* read(snapshot_reader& r)
+	{
+		return new constant(r.get_oper());
+	}
+};
+
+// restore handles from the last session
+static const bool snapshots = snapshot::enable();
+
+AddIn xai_constant(
+	Function(XLL_HANDLEX, "xll_constant", "\\XLL.CONSTANT")
+	.Arguments({
+		Arg(XLL_LPOPER, "cell", "is a cell or range of cells")
+		})
+	.Uncalced() // required for functions creating handles
+	.FunctionHelp("Return a handle to a constant object restored from the last session if cell has not changed.")
+);
+HANDLEX WINAPI xll_constant(LPOPER px)
+{
+#pragma XLLEXPORT
+	// read from the snapshot if the add-in closed with the same cell value
+	xll::handle<constant> h(snapshot_key(*px), [px]() { return new constant(*px); });
+
+	return h.get();
+}
+
+AddIn xai_constant_get(
+	Function(XLL_LPOPER, "xll_constant_get", "XLL.CONSTANT.GET")
+	.Arguments({
+		Arg(XLL_HANDLEX, "handle", "is a handle returned by \\XLL.CONSTANT")
+		})
+	.FunctionHelp("Return the value stored in constant.")
+);
+LPOPER WINAPI xll_constant_get(HANDLEX _h)
+{
+#pragma XLLEXPORT
+	static OPER o;
+	xll::handle<constant> h(_h);
+
+	o = h ? h->get() : OPER(ErrNA);
+
+	return &o;
+}
+
 // convert pointers to and from "\\base[0x<hexdigits>]"
 static handle<base<OPER>>::codec base_codec; // ("\\base[0x", "]");
 
@@ -219,6 +284,13 @@ int WINAPI xll_handle_test()
 
 		ensure(Excel(xlfGetCell, 5, REF(7, 0)) == 4.56); // derived isa base
 		ensure(Excel(xlfGetCell, 5, REF(8, 0)) == "derived");
+
+		// test constant
+		Excel(xlcFormula, "constant", REF(10, 0));
+		Excel(xlcFormula, "=\\XLL.CONSTANT(R[-1]C[0])", REF(11, 0));
+		Excel(xlcFormula, "=XLL.CONSTANT.GET(R[-1]C[0])", REF(12, 0));
+
+		ensure(Excel(xlfGetCell, 5, REF(12, 0)) == "constant");
 		/*
 		// use pretty handles
 		Excel(xlcFormula, "=\\XLL.EBASE(R1C1)", REF(10, 0));
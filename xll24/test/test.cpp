@@ -4,8 +4,12 @@
 #include <numeric>
 #include <random>
 #include <sstream>
+#include <thread>
 #include "xll.h"
 #include "excel_time.h"
+#include "fp_expr.h"
+#include "parallel.h"
+#include "simd.h"
 
 using namespace xll;
 
@@ -516,6 +520,46 @@ int multi_test()
 		OPER q = expand(p);
 		ensure(o == q);
 	}
+	{
+		OPER o({ OPER(1.23), OPER({ OPER(L"a"), OPER({ OPER(true), OPER(2) }) }) });
+		double h;
+		{
+			OPER p = compress(o);
+			h = p[1].val.num;
+			ensure(handles::find(h));
+			{
+				OPER x(h);
+				OPER c(p);
+			}
+			ensure(handles::find(h)); // only p owns the handle
+			ensure(expand(p) == o);
+		}
+		ensure(!handles::find(h));
+	}
+	{
+		OPER o({ OPER(1.23), OPER({ OPER(L"a"), OPER(2) }) });
+		OPER c;
+		double h;
+		{
+			OPER p = compress(o);
+			h = p[1].val.num;
+			c = p;
+			OPER q({ OPER(h), OPER(h) }); // not compressed
+			OPER r = compress(OPER({ OPER(h), OPER(2) }));
+			ensure(expand(q) == q);
+			ensure(expand(r)[0] == OPER(h));
+		}
+		ensure(handles::find(h)); // held by the copy
+		ensure(expand(c) == o);
+		c.vstack(OPER({ OPER(4.56), OPER(7.89) }));
+		ensure(handles::find(h));
+		ensure(expand(c[1]) == o[1]);
+		OPER a = arena(c);
+		c = OPER();
+		ensure(handles::find(h)); // held by the arena
+		a = OPER();
+		ensure(!handles::find(h));
+	}
 	{
 		OPER o({ OPER(1.23), OPER(L"abc"), OPER(true) });
 		ensure(o == OPER().vstack(o));
@@ -589,6 +633,814 @@ int multi_test()
 	return 0;
 }
 
+int builder_test()
+{
+	{
+		OPER o;
+		for (int i = 0; i < 100; ++i) {
+			o.append(OPER(i));
+		}
+		ensure(rows(o) == 1);
+		ensure(columns(o) == 100);
+		ensure(o.capacity() >= 100);
+		ensure(o.capacity() < 200);
+		for (int i = 0; i < 100; ++i) {
+			ensure(o[i] == i);
+		}
+	}
+	{
+		OPER o({ OPER(1), OPER(L"a") });
+		o.resize(2, 1);
+		o.append(o[1]);
+		o.append(std::move(o[0]));
+		ensure(rows(o) == 4);
+		ensure(columns(o) == 1);
+		ensure(o[2] == L"a");
+		ensure(o[3] == 1);
+	}
+	{
+		OPER o;
+		o.vstack(OPER({ OPER(1), OPER(L"a") }));
+		o.reserve(10);
+		ensure(o.capacity() == 10);
+		OPER row({ OPER(2), OPER(L"b") });
+		o.vstack(std::move(row));
+		ensure(isNil(row));
+		o.vstack(o);
+		ensure(rows(o) == 4);
+		ensure(columns(o) == 2);
+		ensure(o(1, 1) == L"b");
+		ensure(o(3, 0) == 2);
+	}
+	{
+		OPER o({ OPER(1), OPER(2) });
+		o.resize(2, 1);
+		o.hstack(OPER({ OPER(L"a"), OPER(L"b") }).resize(2, 1));
+		o.hstack(o);
+		ensure(rows(o) == 2);
+		ensure(columns(o) == 4);
+		ensure(o == OPER({ OPER(1), OPER(L"a"), OPER(1), OPER(L"a"),
+			OPER(2), OPER(L"b"), OPER(2), OPER(L"b") }).resize(2, 4));
+		ensure(OPER(1).hstack(OPER(2)) == OPER({ OPER(1), OPER(2) }));
+		ensure(OPER(1).hstack(OPER(2, 1)) == ErrValue);
+	}
+	{
+		OPER o(40, 50);
+		for (int i = 0; i < size(o); ++i) {
+			o[i] = (i % 2) ? OPER(i) : OPER(std::to_wstring(i));
+		}
+		OPER t(o);
+		const XCHAR* s = t(1, 0).val.str;
+		t.transpose();
+		ensure(rows(t) == 50);
+		ensure(columns(t) == 40);
+		ensure(t(0, 1).val.str == s);
+		for (int i = 0; i < rows(o); ++i) {
+			for (int j = 0; j < columns(o); ++j) {
+				ensure(t(j, i) == o(i, j));
+			}
+		}
+		ensure(t.transpose() == o);
+		ensure(OPER({ OPER(1), OPER(2) }).transpose() == OPER({ OPER(1), OPER(2) }).resize(2, 1));
+		OPER a = arena(o);
+		a.transpose();
+		ensure(isBlock(a));
+		ensure(isArena(a(0, 1)));
+		ensure(a == t.transpose());
+	}
+	{
+		OPER o({ OPER(1), OPER(2) });
+		o.resize(2, 1);
+		OPER x({ OPER(L"a"), OPER(L"b"), OPER(L"c"), OPER(L"d") });
+		x.resize(2, 2);
+		o.hstack(std::move(x));
+		ensure(isNil(x));
+		ensure(o == OPER({ OPER(1), OPER(L"a"), OPER(L"b"), OPER(2), OPER(L"c"), OPER(L"d") }).resize(2, 3));
+	}
+	{
+		OPER o({ OPER(L"abc"), OPER({ OPER(L"x"), OPER(true) }) });
+		OPER a = arena(o);
+		a.vstack(o);
+		ensure(!isBlock(a));
+		ensure(a(0, 0) == o[0]);
+		ensure(a(1, 1) == o[1]);
+	}
+
+	return 0;
+}
+
+int intern_test()
+{
+	{
+		OPER a = intern(L"abc");
+		OPER b = intern("abc");
+		ensure(isInterned(a));
+		ensure(a.val.str == b.val.str);
+		ensure(a == OPER(L"abc"));
+		ensure(!isInterned(OPER(L"abc")));
+
+		OPER c(a);
+		ensure(c.val.str == a.val.str);
+		OPER d = static_cast<const XLOPER12&>(a);
+		ensure(d.val.str == a.val.str);
+		OPER m({ a, OPER(1), a });
+		ensure(m[0].val.str == m[2].val.str);
+		OPER e = std::move(c);
+		ensure(e.val.str == a.val.str);
+		ensure(isNil(c));
+	}
+	{
+		OPER a = intern(L"a b");
+		ensure(a.safe_name() == L"a_b");
+		ensure(a == L"a b");
+		ensure(intern(L"a b") == L"a b");
+	}
+	{
+		const XCHAR* p;
+		{
+			OPER t = intern(L"intern_test");
+			p = t.val.str;
+		}
+		OPER t = intern(L"intern_test");
+		ensure(t == L"intern_test");
+		ensure(t.val.str == p); // released memory is reused
+		ensure(intern(L"") == OPER(L""));
+	}
+	{
+		const XCHAR* p;
+		{
+			OPER t = intern(L"intern_abc");
+			p = t.val.str;
+		}
+		OPER t = intern(L"intern_xyz");
+		ensure(t == L"intern_xyz");
+		ensure(t.val.str == p); // same size
+		ensure(intern(L"intern_abc") == L"intern_abc");
+	}
+	{
+		Arg x(XLL_DOUBLE, L"x", L"is a number.");
+		Arg y(XLL_DOUBLE, "y", "is a number.");
+		ensure(x.type.val.str == y.type.val.str);
+		ensure(x.help.val.str == y.help.val.str);
+		Function f = Function(XLL_DOUBLE, L"f", L"F").Arguments({ x, y }).Category(L"XLL");
+		ensure(f.argumentType[0].val.str == f.argumentType[1].val.str);
+		ensure(f.category.val.str == intern(L"XLL").val.str);
+	}
+
+	return 0;
+}
+
+int pointer_map_test()
+{
+	{
+		pointer_map<int> m;
+		ensure(!m.contains(nullptr));
+		ensure(!m.try_emplace(nullptr, 1).second);
+		bool thrown = false;
+		try {
+			m[nullptr] = 1;
+		}
+		catch (const std::exception&) {
+			thrown = true;
+		}
+		ensure(thrown);
+		ensure(m.size() == 0);
+	}
+	{
+		// Churn against std::map.
+		std::vector<int> x(10000);
+		pointer_map<int> m;
+		std::map<const void*, int> m_;
+		for (int n = 0; n < 100000; ++n) {
+			const int i = rand_integral(0, static_cast<int>(x.size()) - 1);
+			const void* p = &x[i];
+			if (rand_bool()) {
+				ensure(m.try_emplace(p, i).second == m_.emplace(p, i).second);
+			}
+			else {
+				ensure(m.erase(p) == (m_.erase(p) == 1));
+			}
+			ensure(m.size() == m_.size());
+		}
+		for (int i = 0; i < static_cast<int>(x.size()); ++i) {
+			const int* pi = m.find(&x[i]);
+			ensure(m_.contains(&x[i]) ? (pi && *pi == i) : !pi);
+		}
+	}
+	{
+		pointer_set s;
+		int i;
+		ensure(s.insert(&i));
+		ensure(!s.insert(&i));
+		ensure(s.contains(&i));
+		ensure(s.erase(&i));
+		ensure(!s.contains(&i));
+	}
+
+	return 0;
+}
+
+int concurrent_pointer_map_test()
+{
+	{
+		concurrent_pointer_map<int> m;
+		int v;
+		ensure(!m.contains(nullptr));
+		ensure(!m.insert(nullptr, 1));
+		ensure(!m.find(&v, v));
+		ensure(m.size() == 0);
+	}
+	{
+		// Churn against std::map. Tombstones are reused and tables rebuilt.
+		std::vector<int> x(10000);
+		concurrent_pointer_map<int> m;
+		std::map<const void*, int> m_;
+		for (int n = 0; n < 100000; ++n) {
+			const int i = rand_integral(0, static_cast<int>(x.size()) - 1);
+			const void* p = &x[i];
+			if (rand_bool()) {
+				ensure(m.insert(p, i) == m_.emplace(p, i).second);
+			}
+			else {
+				ensure(m.erase(p) == (m_.erase(p) == 1));
+			}
+			ensure(m.size() == m_.size());
+		}
+		for (int i = 0; i < static_cast<int>(x.size()); ++i) {
+			int v = -1;
+			ensure(m.find(&x[i], v) == m_.contains(&x[i]));
+			ensure(!m_.contains(&x[i]) || v == i);
+		}
+		size_t n = 0;
+		m.for_each([&](const void* p, int v) {
+			ensure(m_.at(p) == v);
+			++n;
+		});
+		ensure(n == m_.size());
+		ensure(m.assign(m_.begin()->first, -1));
+		int v;
+		ensure(m.find(m_.begin()->first, v) && v == -1);
+		m.clear();
+		ensure(m.size() == 0 && !m.contains(m_.begin()->first));
+	}
+	{
+		// Readers never see a key without its value while a writer churns.
+		std::vector<int> x(1000);
+		concurrent_pointer_map<int> m;
+		for (int i = 0; i < 500; ++i) {
+			m.insert(&x[i], i);
+		}
+		std::atomic<bool> done = false;
+		std::atomic<int> bad = 0;
+		std::vector<std::thread> readers;
+		for (int t = 0; t < 4; ++t) {
+			readers.emplace_back([&]() {
+				while (!done) {
+					for (int i = 0; i < static_cast<int>(x.size()); ++i) {
+						int v;
+						if (m.find(&x[i], v) && v != i) {
+							++bad;
+						}
+						// never erased
+						if (i < 100 && !m.contains(&x[i])) {
+							++bad;
+						}
+					}
+				}
+			});
+		}
+		std::minstd_rand r;
+		for (int n = 0; n < 100000; ++n) {
+			const int i = 100 + static_cast<int>(r() % (x.size() - 100));
+			m.erase(&x[i]) || m.insert(&x[i], i);
+		}
+		done = true;
+		for (auto& t : readers) {
+			t.join();
+		}
+		ensure(bad == 0);
+	}
+	{
+		concurrent_pointer_set s;
+		int i;
+		ensure(s.insert(&i));
+		ensure(!s.insert(&i));
+		ensure(s.contains(&i));
+		ensure(s.erase(&i));
+		ensure(!s.contains(&i));
+	}
+
+	return 0;
+}
+
+struct handle_test_a {
+	int a;
+};
+struct handle_test_b {
+	int b;
+};
+
+// Lookups from the caller that created a handle are temporary and erase it.
+int handle_test()
+{
+	{
+		const slot_handle s{ 3, 0xFFFF, (1u << slot_handle::slot_bits) - 1 };
+		const HANDLEX h = s.encode();
+		ensure(slot_handle::is(h));
+		const slot_handle s_ = slot_handle::decode(h);
+		ensure(s_.tag == 3 && s_.generation == 0xFFFF && s_.slot == s.slot);
+		int i;
+		ensure(!slot_handle::is(to_handle(&i)));
+		ensure(handle_tag<handle_test_a>() != handle_tag<handle_test_b>());
+	}
+	{
+		// Calling cells are compared exactly.
+		auto& ids = detail::caller_ids();
+		const OPER a(REF(1, 2)), b(REF(2, 1));
+		ensure(!ids.find(OPER(REF(1234, 567))));
+		const uint64_t ia = ids.id(a);
+		ensure(ia && ids.id(a) == ia && ids.find(a) == ia);
+		ensure(ids.id(b) != ia);
+		XLMREF12 mref{ 1, { { 1, 1, 2, 2 } } };
+		XLOPER12 x{ .val = { .mref = { &mref, 1 } }, .xltype = xltypeRef };
+		const uint64_t ix = ids.id(x);
+		ensure(ix != ia && ids.id(x) == ix);
+		x.val.mref.idSheet = 2;
+		ensure(ids.id(x) != ix);
+	}
+	{
+		HANDLEX h;
+		handle_test_a* p;
+		{
+			handle<handle_test_a> a(new handle_test_a{ 1 });
+			h = a.get();
+			p = a.ptr();
+			ensure(slot_handle::is(h));
+			ensure(!handle<handle_test_b>(h));
+		}
+		{
+			// Pointer handles find the slot.
+			handle<handle_test_a> a(to_handle(p));
+			ensure(a && a->a == 1 && a.is_temporary());
+		}
+		ensure(!handle<handle_test_a>(h));
+		ensure(!handle<handle_test_a>(to_handle(p)));
+	}
+	{
+		// Handles created in several arguments of one formula are all temporary.
+		HANDLEX h1, h2;
+		{
+			handle<handle_test_a> a(new handle_test_a{ 1 });
+			h1 = a.get();
+		}
+		{
+			handle<handle_test_a> a(new handle_test_a{ 2 });
+			h2 = a.get();
+		}
+		{
+			handle<handle_test_a> a1(h1), a2(h2);
+			ensure(a1.is_temporary() && a2.is_temporary());
+		}
+		ensure(!handle<handle_test_a>(h1) && !handle<handle_test_a>(h2));
+	}
+	{
+		// More arguments than recent handles are remembered.
+		std::vector<HANDLEX> hs;
+		for (int i = 0; i < 20; ++i) {
+			handle<handle_test_a> a(new handle_test_a{ i });
+			hs.push_back(a.get());
+		}
+		for (HANDLEX h : hs) {
+			handle<handle_test_a> a(h);
+			ensure(a && a.is_temporary());
+		}
+		for (HANDLEX h : hs) {
+			ensure(!handle<handle_test_a>(h));
+		}
+	}
+	{
+		// Slots are reused with a new generation.
+		std::vector<HANDLEX> hs;
+		for (int i = 0; i < 3000; ++i) {
+			HANDLEX h;
+			{
+				handle<handle_test_a> a(new handle_test_a{ i });
+				h = a.get();
+			}
+			{
+				handle<handle_test_a> a(h);
+				ensure(a && a->a == i);
+			}
+			hs.push_back(h);
+		}
+		for (HANDLEX h : hs) {
+			ensure(!handle<handle_test_a>(h));
+		}
+		ensure(slot_handle::decode(hs.back()).slot < 2000);
+	}
+	{
+		handle<handle_test_a>::codec c("\\a[", "]");
+		const HANDLEX h = slot_handle{ 1, 2, 3 }.encode();
+		ensure(c.decode(c.encode(h)) == h);
+	}
+
+	return 0;
+}
+
+struct slab_test_a : slab_allocated<slab_test_a> {
+	double a;
+	slab_test_a(double a)
+		: a(a)
+	{ }
+	virtual ~slab_test_a()
+	{ }
+};
+struct slab_test_b : slab_test_a {
+	double b[4] = {};
+	using slab_test_a::slab_test_a;
+};
+
+int slab_test()
+{
+	{
+		slab s("s", 3, 1);
+		void* p = s.allocate();
+		void* q = s.allocate();
+		ensure(p != q);
+		ensure(reinterpret_cast<uintptr_t>(p) % alignof(void*) == 0);
+		s.deallocate(q);
+		// Last freed is reused first.
+		ensure(s.allocate() == q);
+		s.deallocate(p);
+		s.deallocate(q);
+		const slab_stats st = s.stats();
+		ensure(st.size == sizeof(void*));
+		ensure(st.chunks == 1 && st.in_use == 0);
+		ensure(st.allocations == 3 && st.frees == 3);
+	}
+	{
+		// Recalculating does not add chunks.
+		auto cycle = [](int i) {
+			HANDLEX h;
+			{
+				handle<slab_test_a> a(new slab_test_a(i));
+				h = a.get();
+			}
+			handle<slab_test_a> a(h);
+			ensure(a && a->a == i);
+		};
+		cycle(0);
+		const slab_stats s0 = slab_of<slab_test_a>().stats();
+		for (int i = 0; i < 1000; ++i) {
+			cycle(i);
+		}
+		const slab_stats s1 = slab_of<slab_test_a>().stats();
+		ensure(s1.chunks == s0.chunks && s1.in_use == s0.in_use);
+		ensure(s1.allocations == s0.allocations + 1000 && s1.frees == s0.frees + 1000);
+	}
+	{
+		// Derived classes use the global heap.
+		const slab_stats s0 = slab_of<slab_test_a>().stats();
+		slab_test_a* p = new slab_test_b(1);
+		delete p;
+		ensure(slab_of<slab_test_a>().stats().allocations == s0.allocations);
+		bool found = false;
+		slab::for_each([&found](const slab_stats& s) {
+			found = found || s.name == typeid(slab_test_a).name();
+		});
+		ensure(found);
+	}
+
+	return 0;
+}
+
+struct snapshot_test_a {
+	OPER x;
+};
+template<>
+struct xll::serialize<snapshot_test_a> {
+	static constexpr uint32_t version = 2;
+	static void write(snapshot_writer& w, const snapshot_test_a& a)
+	{
+		w.put(a.x);
+	}
+	static snapshot_test_a* read(snapshot_reader& r)
+	{
+		return new snapshot_test_a{ r.get_oper() };
+	}
+};
+
+int snapshot_test()
+{
+	// Leave the add-in's snapshot alone.
+	static snapshot local;
+	handle<snapshot_test_a>::use(local);
+	{
+		std::string buf;
+		snapshot_writer w(buf);
+		const OPER o({ OPER(1.5), OPER(L"abc"), OPER(true), OPER(xlerr::NA), OPER(), OPER(7) });
+		w.put(o).put(std::string_view("xyz")).put<uint16_t>(3);
+		snapshot_reader r(buf);
+		ensure(r.get_oper() == o);
+		ensure(r.get_string() == "xyz");
+		ensure(r.get<uint16_t>() == 3);
+		ensure(r.size() == 0);
+	}
+	{
+		ensure(snapshot_key(OPER(L"abc"), 1.).value() == snapshot_key(OPER(L"abc"), 1.).value());
+		ensure(snapshot_key(OPER(L"abc"), 1.).value() != snapshot_key(OPER(L"abd"), 1.).value());
+		ensure(snapshot_key(OPER(L"abc")).value() != snapshot_key(OPER(L"ABC")).value());
+	}
+
+	const uint64_t type = snapshot_type<snapshot_test_a>();
+	const uint32_t version = serialize_version<snapshot_test_a>();
+	const uint64_t key = snapshot_key(OPER(L"abc")).value();
+	snapshot::out o;
+	ensure(o.add(type, key, version, [](snapshot_writer& w) {
+		serialize<snapshot_test_a>::write(w, snapshot_test_a{ OPER(L"abc") });
+	}));
+	// Same key is written once.
+	ensure(!o.add(type, key, version, [](snapshot_writer&) {}));
+	// Objects that cannot be written are left out.
+	ensure(!o.add(type, key + 2, version, [](snapshot_writer& w) {
+		w.put(OPER(REF(0, 0)));
+	}));
+	// Entries that are written but cannot be read.
+	ensure(o.add(type, snapshot_key(OPER(L"bad")).value(), version, [](snapshot_writer& w) {
+		w.put<uint32_t>(xltypeStr);
+	}));
+	ensure(o.size() == 2);
+	const std::string data = o.data();
+	{
+		snapshot s;
+		ensure(s.attach(data));
+		ensure(s.size() == 2);
+		const uint64_t off = s.find(type, key, version);
+		ensure(off);
+		std::unique_ptr<snapshot_test_a> p(s.read<snapshot_test_a>(off));
+		ensure(p && p->x == OPER(L"abc"));
+		// Stale inputs and formats are not found.
+		ensure(!s.find(type, key + 2, version));
+		ensure(!s.find(type, key, version + 1));
+		ensure(!s.find(type + 1, key, version));
+	}
+	{
+		// Entries can be read after the file is replaced.
+		const auto path = std::filesystem::temp_directory_path() / L"xll_snapshot_test.snapshot";
+		{
+			std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+			ofs.write(data.data(), data.size());
+		}
+		snapshot s;
+		ensure(s.open(path));
+		const uint64_t off = s.find(type, key, version);
+		s.detach();
+		ensure(std::filesystem::remove(path));
+		std::unique_ptr<snapshot_test_a> p(s.read<snapshot_test_a>(off));
+		ensure(p && p->x == OPER(L"abc"));
+		ensure(!s.attach(data));
+	}
+	{
+		snapshot s;
+		ensure(!s.attach(std::string_view(data).substr(0, data.size() - 8)));
+		ensure(!s.attach(std::string_view("not a snapshot")));
+	}
+	{
+		// Handles created with a key are saved.
+		int made = 0;
+		HANDLEX h;
+		{
+			handle<snapshot_test_a> a(snapshot_key(OPER(L"def")), [&made]() {
+				++made;
+				return new snapshot_test_a{ OPER(L"def") };
+			});
+			ensure(a && a->x == OPER(L"def"));
+			h = a.get();
+		}
+		snapshot::out o_ = local.save();
+		snapshot s;
+		ensure(s.attach(o_.data()));
+		const uint64_t off = s.find(type, snapshot_key(OPER(L"def")).value(), version);
+		ensure(off);
+		std::unique_ptr<snapshot_test_a> p(s.read<snapshot_test_a>(off));
+		ensure(p && p->x == OPER(L"def"));
+		ensure(made == 1);
+		// Erase as a temporary.
+		ensure(handle<snapshot_test_a>(h));
+		ensure(!handle<snapshot_test_a>(h));
+	}
+	{
+		// Handle inputs use the key of their object and not the handle number.
+		auto make = []() { return new snapshot_test_a{ OPER(L"ghi") }; };
+		HANDLEX hs[3];
+		{
+			handle<snapshot_test_a> a(snapshot_key(OPER(L"ghi")), make);
+			const uint64_t k = snapshot_key(a.get()).value();
+			ensure(k && k != snapshot_key(OPER(L"ghi")).value());
+			ensure(snapshot_key(OPER({ OPER(1.), OPER(a.get()) })).value());
+			handle<snapshot_test_a> b(snapshot_key(OPER(L"ghi")), make);
+			ensure(b.get() != a.get());
+			ensure(snapshot_key(b.get()).value() == k);
+			// Handles created without a key give no key.
+			handle<snapshot_test_a> c(new snapshot_test_a{ OPER(L"jkl") });
+			ensure(snapshot_key(c.get()).value() == 0);
+			ensure(snapshot_key(OPER({ OPER(1.), OPER(c.get()) })).value() == 0);
+			ensure(snapshot_key(1.).value() != 0);
+			hs[0] = a.get();
+			hs[1] = b.get();
+			hs[2] = c.get();
+		}
+		for (HANDLEX h : hs) {
+			ensure(handle<snapshot_test_a>(h));
+			ensure(!handle<snapshot_test_a>(h));
+			// Stale handles hash as numbers.
+			ensure(snapshot_key(h).value() == snapshot_key(OPER(h)).value());
+			ensure(snapshot_key(h).value() != 0);
+		}
+		// Numbers that look like handles of no type.
+		ensure(snapshot_key(slot_handle{ 255, 0, 12345 }.encode()).value() != 0);
+	}
+	{
+		// Objects are read from the snapshot when first used.
+		ensure(local.attach(data));
+		int made = 0;
+		auto make = [&made]() {
+			++made;
+			return new snapshot_test_a{ OPER(L"abc") };
+		};
+		HANDLEX h;
+		{
+			handle<snapshot_test_a> a(snapshot_key(OPER(L"abc")), make);
+			h = a.get();
+		}
+		ensure(made == 0);
+		{
+			// Read when first used.
+			handle<snapshot_test_a> a(h);
+			ensure(a && a->x == OPER(L"abc"));
+		}
+		ensure(!handle<snapshot_test_a>(h));
+		{
+			// Erased if it cannot be read.
+			handle<snapshot_test_a> a(snapshot_key(OPER(L"bad")), make);
+			ensure(!a && !a.ptr());
+			h = a.get();
+		}
+		ensure(made == 0);
+		ensure(!handle<snapshot_test_a>(h));
+		{
+			handle<snapshot_test_a> a(snapshot_key(OPER(L"abd")), make);
+			ensure(made == 1);
+			h = a.get();
+		}
+		ensure(handle<snapshot_test_a>(h));
+		ensure(!handle<snapshot_test_a>(h));
+		local.close();
+	}
+
+	return 0;
+}
+
+int hash_test()
+{
+	{
+		// Equal values have equal hashes.
+		const OPER xs[] = {
+			OPER(0.), OPER(-0.), OPER(1.23), OPER(L"abc"), OPER(true), OPER(ErrNA), OPER(),
+			OPER({ OPER(1.23), OPER(L"abc"), OPER({ OPER(L"x"), OPER(true) }) }),
+		};
+		for (const auto& x : xs) {
+			const OPER y(x);
+			ensure(x == y);
+			ensure(hash(x) == hash(y));
+			ensure(std::hash<OPER>{}(x) == hash(y));
+		}
+		ensure(hash(OPER(0.)) == hash(OPER(-0.)));
+		ensure(hash(OPER(L"abc")) == hash(intern(L"abc")));
+		ensure(hash(OPER(L"abc")) != hash(OPER(L"ABC")));
+		ensure(hash(OPER(1)) != hash(OPER(L"1")));
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		ensure(hash(OPER(nan)) == hash(OPER(-nan)));
+		OPER m({ OPER(1), OPER(2) });
+		OPER m2 = m;
+		m2.resize(2, 1);
+		ensure(m != m2);
+		ensure(hash(m) != hash(m2));
+	}
+	{
+		oper_map<int> m;
+		for (int i = 0; i < 1000; ++i) {
+			m[OPER(1. * i)] = i;
+			m[OPER(std::to_wstring(i))] = -i;
+		}
+		ensure(m.size() == 2000);
+		ensure(m.at(OPER(10.)) == 10);
+		ensure(m.at(OPER(L"10")) == -10);
+		// Heterogeneous lookup without constructing an OPER.
+		const XLOPER12 x = Num(7);
+		ensure(m.find(x) != m.end() && m.find(x)->second == 7);
+		ensure(!m.contains(OPER(1000.)));
+
+		oper_set s;
+		ensure(s.insert(OPER(0.)).second);
+		ensure(!s.insert(OPER(-0.)).second);
+	}
+
+	return 0;
+}
+
+int key_index_test()
+{
+	{
+		OPER d(100, 2);
+		for (int i = 0; i < 100; ++i) {
+			d(i, 0) = i % 2 ? OPER(L"k" + std::to_wstring(i)) : OPER(1. * i);
+			d(i, 1) = OPER(-1. * i);
+		}
+		key_index ki(d);
+		ensure(ki.size() == 100);
+		for (int i = 0; i < 100; ++i) {
+			ensure(ki.lookup(d(i, 0)) == lookup(d, d(i, 0)));
+			ensure(ki.value(d(i, 0)) == d(i, 1));
+		}
+		ensure(ki.lookup(OPER(L"k0")) == -1);
+		ensure(ki.value(OPER(L"k0")) == ErrValue);
+
+		OPER keys({ OPER(L"k1"), OPER(2.), OPER(L"none") });
+		keys.resize(3, 1);
+		OPER v = ki.values(keys);
+		ensure(rows(v) == 3 && columns(v) == 1);
+		ensure(v[0] == -1. && v[1] == -2. && v[2] == ErrValue);
+		ensure(ki.values(OPER(L"k3")) == -3.);
+
+		// Transposed dictionary.
+		key_index kt(OPER(d).transpose());
+		ensure(kt.value(OPER(L"k99")) == OPER(-99.));
+	}
+	{
+		// First key wins like a linear scan.
+		OPER d({ OPER(L"a"), OPER(1.), OPER(L"a"), OPER(2.), OPER(L"b"), OPER(3.) });
+		d.resize(3, 2);
+		key_index ki(d);
+		ensure(ki.size() == 2);
+		ensure(ki.value(OPER(L"a")) == value(d, OPER(L"a")));
+	}
+	{
+		bool thrown = false;
+		try {
+			key_index ki(OPER(1, 3));
+		}
+		catch (const std::exception&) {
+			thrown = true;
+		}
+		ensure(thrown);
+	}
+
+	return 0;
+}
+
+int arena_test()
+{
+	{
+		OPER o({ OPER(1.23), OPER(L"abc"), OPER({ OPER(L"x"), OPER(true) }) });
+		OPER a = arena(o);
+		ensure(a == o);
+		ensure(isBlock(a));
+		ensure(isArena(a[1]));
+		ensure(isArena(a[2]));
+		ensure(isArena(a[2][0]));
+
+		a[1] = OPER(L"def");
+		ensure(!isArena(a[1]));
+		ensure(a[1] == L"def");
+
+		OPER x = std::move(a[2][0]); // copied out of the arena
+		ensure(!isArena(x));
+		ensure(x == L"x");
+		ensure(a[2][0] == L"x");
+
+		OPER b(a);
+		ensure(!isBlock(b));
+		ensure(b == a);
+		OPER c = std::move(a);
+		ensure(isBlock(c));
+		ensure(c == b);
+	}
+	{
+		OPER o(100, 200);
+		for (auto& oi : o) {
+			oi = rand_OPER(rand_type(), 2, 3);
+		}
+		ensure(arena(o) == o);
+	}
+	{
+		ensure(arena(OPER(L"abc")) == L"abc");
+		ensure(arena(OPER(1.23)) == 1.23);
+	}
+
+	return 0;
+}
+
 int json_test()
 {
 	OPER o{ OPER(L"a"), OPER(L"b"), OPER(L"c"), OPER(1), OPER(L"two"), OPER(false)};
@@ -663,6 +1515,14 @@ int excel_test()
 		OPER p = Excel(xlfText, o, L"yyyy-mm-dd");
 		ensure(p == L"2024-01-02");
 	}
+	{
+		// Arguments are passed by pointer and array results are in one block.
+		OPER o(1000, 2);
+		ensure(Excel(xlfRows, o) == 1000);
+		OPER m = Excel(xlfTranspose, OPER({ OPER(L"a"), OPER(1.5) }));
+		ensure(isBlock(m));
+		ensure(m == OPER({ OPER(L"a"), OPER(1.5) }).resize(2, 1));
+	}
 
 	return 0;
 }
@@ -770,6 +1630,541 @@ int fp_test()
 		ensure(a(2, 0) == 3);
 		ensure(a(0, 1) == 4);
 	}
+	{
+		FPX a;
+		ensure(a.capacity() == 0);
+		int moves = 0;
+		const double* pa = nullptr;
+		for (int i = 0; i < 1000; ++i) {
+			a.append(i);
+			if (a.array() != pa) {
+				pa = a.array();
+				++moves;
+			}
+		}
+		ensure(size(a) == 1000 && rows(a) == 1);
+		ensure(a.capacity() >= 1000 && a.capacity() < 2000);
+		ensure(moves < 20);
+		ensure(a[999] == 999);
+		// Layout seen by Excel is unchanged.
+		ensure(a.get()->rows == 1 && a.get()->columns == 1000 && a.get()->array[999] == 999);
+
+		a.resize(1, 10);
+		ensure(a.capacity() >= 1000);
+		a.shrink_to_fit();
+		ensure(a.capacity() == 10);
+		ensure(a[9] == 9);
+
+		a.reserve(100);
+		pa = a.array();
+		for (int i = 10; i < 100; ++i) {
+			a.append(i);
+		}
+		ensure(a.array() == pa);
+		ensure(a[99] == 99);
+
+		FPX b(1, 2);
+		for (int i = 0; i < 100; ++i) {
+			b.vstack(FPX({ 1. * i, -1. * i }));
+		}
+		ensure(rows(b) == 101 && columns(b) == 2);
+		ensure(b.capacity() < 2 * 2 * 101);
+		ensure(b(100, 1) == -99);
+	}
+	{
+		// Arrays start on a cache line for every allocator.
+		auto aligned = [](const FPX& a) { return reinterpret_cast<uintptr_t>(a.get()->array) % FPX_ALIGN == 0; };
+		for (int n : { 1, 2, 7, 8, 9, 1000, 200'000 }) {
+			FPX a(1, n);
+			ensure(aligned(a));
+			a.append(1);
+			ensure(aligned(a));
+			fpx_allocator_scope scope(fpx_allocator_pages);
+			FPX b(n, 1);
+			ensure(aligned(b));
+			b[n - 1] = 1;
+		}
+		ensure(fpx_get_allocator() == &fpx_allocator_aligned);
+
+		alignas(64) static char buf[4096];
+		fpx_arena arena;
+		fpx_arena_init(&arena, buf + 8, sizeof(buf) - 8);
+		auto in_arena = [](const FPX& a) {
+			const char* p = reinterpret_cast<const char*>(a.get()->array);
+			return buf <= p && p < buf + sizeof(buf);
+		};
+		{
+			fpx_allocator_scope scope(arena.allocator);
+			FPX a(2, 3), b(1, 100);
+			ensure(aligned(a) && aligned(b));
+			ensure(in_arena(a) && in_arena(b));
+			const size_t used = arena.used;
+			// Growing allocates a new block in the arena.
+			b.resize(1, 101);
+			b[100] = 1;
+			ensure(arena.used > used);
+			// Does not fit so comes from the heap.
+			FPX c(10, 100);
+			ensure(aligned(c));
+			ensure(!in_arena(c));
+			c(9, 99) = 1;
+		}
+		ensure(fpx_get_allocator() == &fpx_allocator_aligned);
+		fpx_arena_reset(&arena);
+		ensure(arena.used == 0);
+	}
+	{
+		FPX a({ 1, 2, 3, 4, 5, 6 });
+		a.resize(2, 3);
+		FPX b({ 7, 8 });
+		b.resize(2, 1);
+		a.hstack(b);
+		ensure(rows(a) == 2 && columns(a) == 4);
+		ensure(a == FPX({ 1, 2, 3, 7, 4, 5, 6, 8 }).resize(2, 4));
+		a.hstack(a);
+		ensure(columns(a) == 8 && a(1, 7) == 8);
+		a.vstack(a);
+		ensure(rows(a) == 4 && a(3, 0) == 4);
+
+		FPX c({ 9 });
+		const FPX e;
+		FPX h = hstack(b, e, c.resize(1, 1).vstack(c), b);
+		ensure(rows(h) == 2 && columns(h) == 3);
+		ensure(h == FPX({ 7, 9, 7, 8, 9, 8 }).resize(2, 3));
+		FPX v = vstack(FPX({ 1, 2 }), e, FPX({ 3, 4 }), FPX({ 5, 6 }));
+		ensure(v == FPX({ 1, 2, 3, 4, 5, 6 }).resize(3, 2));
+		bool thrown = false;
+		try {
+			hstack(b, FPX({ 1, 2, 3 }));
+		}
+		catch (const std::exception&) {
+			thrown = true;
+		}
+		ensure(thrown);
+	}
+	{
+		FPX a(3, 4);
+		for (int i = 0; i < a.size(); ++i) {
+			a[i] = i;
+		}
+		auto c1 = column(a, 1);
+		ensure(c1.size() == 3);
+		ensure(c1[0] == 1 && c1[1] == 5 && c1[2] == 9);
+		ensure(std::accumulate(c1.begin(), c1.end(), 0.) == 15);
+		ensure(c1.end() - c1.begin() == 3);
+		c1[2] = -9;
+		ensure(a(2, 1) == -9);
+		std::sort(c1.begin(), c1.end());
+		ensure(a(0, 1) == -9 && a(2, 1) == 5);
+
+		auto b = block(a, 1, 1, 2, 3);
+		ensure(b.extent(0) == 2 && b.extent(1) == 3 && b.stride(0) == 4);
+		ensure(b(0, 0) == 1 && b(1, 2) == 11);
+		ensure(b.row(1).size() == 3 && b.row(1)[0] == 5);
+		ensure(b.column(2)[1] == 11);
+		ensure(b.block(1, 1, 1, 2)(0, 1) == 11);
+		b(0, 0) = 0;
+		ensure(a(1, 1) == 0);
+
+		const FPX& ca = a;
+		ensure(column(ca, 3)[2] == 11);
+		ensure(block(ca, 0, 0, 3, 4)(2, 3) == 11);
+#ifdef __cpp_lib_mdspan
+		auto m = mdspan(a);
+		ensure(m.extent(0) == 3 && m[2, 3] == 11);
+		auto bm = b.mdspan();
+		ensure(bm.stride(0) == 4 && bm[1, 2] == 11);
+#endif
+	}
+	{
+		// Square, multiple and other shapes larger than a tile.
+		const int shape[][2] = { {33, 33}, {40, 120}, {120, 40}, {37, 101}, {101, 37}, {3, 1000}, {1000, 1} };
+		for (const auto [r, c] : shape) {
+			FPX a(r, c);
+			for (int k = 0; k < r * c; ++k) {
+				a[k] = k;
+			}
+			a.transpose();
+			ensure(rows(a) == c && columns(a) == r);
+			for (int i = 0; i < r; ++i) {
+				for (int j = 0; j < c; ++j) {
+					ensure(a(j, i) == i * c + j);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+// In src/simd.cpp.
+double WINAPI xll_fp_dot(_FP12* px, _FP12* py);
+_FP12* WINAPI xll_fp_axpy(double a, _FP12* px, _FP12* py);
+
+int simd_test()
+{
+	std::mt19937 g(1);
+	std::uniform_real_distribution<double> u(-1, 1);
+	const auto& s = simd::kernels(simd::isa::scalar);
+	// Lengths around every vector width and unroll.
+	for (size_t n = 0; n < 40; ++n) {
+		std::vector<double> x(n), y(n);
+		for (size_t i = 0; i < n; ++i) {
+			x[i] = u(g);
+			y[i] = u(g);
+		}
+		for (auto i : { simd::isa::sse2, simd::isa::avx2, simd::isa::avx512 }) {
+			const auto& k = simd::kernels(i);
+			ensure(std::fabs(k.sum(x.data(), n) - s.sum(x.data(), n)) < 1e-12);
+			ensure(std::fabs(k.sum_kahan(x.data(), n) - s.sum(x.data(), n)) < 1e-12);
+			ensure(std::fabs(k.dot(x.data(), y.data(), n) - s.dot(x.data(), y.data(), n)) < 1e-12);
+			ensure(std::fabs(k.sumsq(x.data(), n, 0.1) - s.sumsq(x.data(), n, 0.1)) < 1e-12);
+			ensure(k.argmin(x.data(), n) == s.argmin(x.data(), n));
+			ensure(k.argmax(x.data(), n) == s.argmax(x.data(), n));
+			std::vector<double> p(n), q = x;
+			k.prefix(x.data(), p.data(), n);
+			k.prefix(q.data(), q.data(), n);
+			for (size_t j = 0; j < n; ++j) {
+				ensure(std::fabs(p[j] - std::accumulate(x.begin(), x.begin() + j + 1, 0.)) < 1e-12);
+				ensure(p[j] == q[j]);
+			}
+			std::vector<double> z = y, w = y;
+			k.axpy(2, x.data(), z.data(), n);
+			s.axpy(2, x.data(), w.data(), n);
+			ensure(z == w);
+		}
+	}
+	{
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		const double inf = std::numeric_limits<double>::infinity();
+		std::vector<double> x{ 3, nan, 1, 2, 1, nan, 5, 5, 0.5, 9 };
+		ensure(simd::argmin(x) == 8);
+		ensure(simd::min(x) == 0.5);
+		ensure(simd::argmax(x) == 9);
+		x[9] = 5;
+		ensure(simd::argmax(x) == 6);
+		ensure(simd::argmin(std::vector<double>(9, nan)) == -1);
+		ensure(std::isnan(simd::min(std::vector<double>{})));
+		ensure(simd::argmin(std::vector<double>{ nan, inf, inf, inf, inf, inf, inf, inf, inf }) == 1);
+	}
+	{
+		ensure(simd::mean(std::vector<double>{ 1, 2, 3, 4 }) == 2.5);
+		ensure(std::fabs(simd::variance(std::vector<double>{ 1, 2, 3, 4 }) - 5. / 3) < 1e-15);
+		ensure(std::isnan(simd::variance(std::vector<double>{ 1 })));
+	}
+	{
+		// Compensated sum recovers the small terms.
+		std::vector<double> x(1001, 0.1);
+		x[0] = 1e10;
+		ensure(simd::sum_kahan(x) - 1e10 == 100);
+		ensure(simd::sum(x) - 1e10 != 100);
+	}
+	{
+		FPX a(2, 3);
+		for (int i = 0; i < a.size(); ++i) {
+			a[i] = i + 1;
+		}
+		ensure(simd::sum(span(a)) == 21);
+		simd::prefix(span(a), span(a));
+		ensure(a(1, 2) == 21);
+	}
+	{
+		// Size mismatches return NaN.
+		FPX x(1, 3), y(1, 2);
+		ensure(std::isnan(xll_fp_dot(x.get(), y.get())));
+		const _FP12* r = xll_fp_axpy(2, x.get(), y.get());
+		ensure(r && size(*r) == 1 && std::isnan(r->array[0]));
+		r = xll_fp_axpy(2, x.get(), x.get());
+		ensure(r && size(*r) == 3);
+	}
+
+	return 0;
+}
+
+int parallel_test()
+{
+	// Sizes below, at and well above the serial cutoff.
+	for (size_t n : { size_t(0), size_t(1), 2 * parallel_grain - 1, 2 * parallel_grain, size_t(1'000'003) }) {
+		std::vector<double> x(n), y(n);
+		for (size_t i = 0; i < n; ++i) {
+			x[i] = static_cast<double>(i);
+		}
+		parallel_transform(x, y, [](double xi) { return 2 * xi; });
+		for (size_t i = 0; i < n; ++i) {
+			ensure(y[i] == 2. * i);
+		}
+		parallel_transform(x, y, y, [](double xi, double yi) { return yi - xi; });
+		ensure(y == x);
+	}
+	{
+		// Every index is visited exactly once.
+		const size_t n = 100'000;
+		std::vector<std::atomic<int>> count(n);
+		parallel_for(n, [&count](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) {
+				++count[i];
+			}
+		}, 100);
+		ensure(std::all_of(count.begin(), count.end(), [](const auto& c) { return c == 1; }));
+	}
+	{
+		FPX a(1000, 100);
+		for (int i = 0; i < a.size(); ++i) {
+			a[i] = i;
+		}
+		parallel_transform(a, [](double x) { return -x; });
+		ensure(a(999, 99) == -(a.size() - 1));
+	}
+	{
+		// Loops inside loops and from several threads run serially instead of waiting.
+		const size_t n = 10 * parallel_grain;
+		std::vector<double> x(n, 1.);
+		std::atomic<double> total = 0;
+		std::vector<std::thread> ts;
+		for (int t = 0; t < 4; ++t) {
+			ts.emplace_back([&]() {
+				parallel_for(n, [&](size_t b, size_t e) {
+					std::vector<double> y(n);
+					parallel_transform(x, y, [](double xi) { return xi; });
+					total += static_cast<double>(e - b) * y[n - 1];
+				});
+			});
+		}
+		for (auto& t : ts) {
+			t.join();
+		}
+		ensure(total == 4. * n);
+	}
+	{
+		// Exceptions are rethrown on the caller.
+		std::vector<double> x(4 * parallel_grain);
+		bool thrown = false;
+		try {
+			parallel_for(x.size(), [](size_t b, size_t) {
+				if (b > 0) {
+					throw std::runtime_error("parallel_test");
+				}
+			}, 1);
+		}
+		catch (const std::runtime_error&) {
+			thrown = true;
+		}
+		ensure(thrown || thread_pool::instance().threads() == 1);
+		// Pool is usable after an exception and after stop.
+		thread_pool::instance().stop();
+		parallel_transform(x, x, [](double) { return 1.; });
+		ensure(x.back() == 1);
+	}
+
+	return 0;
+}
+
+int return_buffer_test()
+{
+	{
+		// Buffers are reused after return_buffers calls and keep their memory.
+		OPER* po = &return_oper(2, 3);
+		const XLOPER12* a = Multi(*po);
+		for (unsigned i = 1; i < return_buffers; ++i) {
+			ensure(&return_oper(1, 1) != po);
+		}
+		OPER& o = return_oper(3, 2);
+		ensure(&o == po && Multi(o) == a);
+		ensure(rows(o) == 3 && columns(o) == 2);
+		o = 1.;
+		for (unsigned i = 1; i < return_buffers; ++i) {
+			return_buffer<OPER>();
+		}
+		ensure(return_oper(1, 1).xltype == xltypeMulti);
+	}
+	{
+		FPX* pa = &return_fp(10, 10);
+		const double* a = pa->array();
+		for (unsigned i = 1; i < return_buffers; ++i) {
+			return_buffer<FPX>();
+		}
+		FPX& b = return_fp(5, 20);
+		ensure(&b == pa && b.array() == a);
+	}
+	{
+		fp12<4, 4>* pa = &return_fp<4, 4>(2, 3);
+		ensure(pa->rows == 2 && pa->columns == 3);
+		for (unsigned i = 1; i < return_buffers; ++i) {
+			const fp12<4, 4>* pb = &return_fp<4, 4>(4, 4);
+			ensure(pb != pa);
+		}
+		fp12<4, 4>& b = return_fp<4, 4>(1, 16);
+		ensure(&b == pa && size(*b.get()) == 16);
+		bool thrown = false;
+		try {
+			return_fp<4, 4>(5, 4);
+		}
+		catch (const std::exception&) {
+			thrown = true;
+		}
+		ensure(thrown);
+	}
+	{
+		auto& pool = dll_free_pool::instance();
+		const size_t n = pool.size();
+		OPER& o = pool.acquire(2, 2);
+		o[0] = L"abc";
+		LPXLOPER12 px = pool.dll_free(o);
+		ensure(px == &o && (px->xltype & xlbitDLLFree));
+		ensure(pool.in_use() == 1);
+		// What xlAutoFree12 does.
+		ensure(pool.release(px));
+		ensure(!(o.xltype & xlbitDLLFree) && pool.in_use() == 0);
+		ensure(!pool.release(px));
+		// Same memory next time.
+		const XLOPER12* a = Multi(o);
+		OPER& o2 = pool.acquire(4, 1);
+		ensure(&o2 == &o && Multi(o2) == a);
+		// Excel does not call xlAutoFree12 for scalars.
+		o2 = 1.;
+		pool.dll_free(o2);
+		ensure(pool.in_use() == 0);
+		OPER x;
+		ensure(!pool.release(&x));
+		ensure(pool.size() == (n ? n : 1));
+	}
+	{
+		// Each thread has its own buffers.
+		OPER* po = &return_buffer<OPER>();
+		OPER* qo = nullptr;
+		std::thread([&qo]() { qo = &return_buffer<OPER>(); }).join();
+		ensure(po != qo);
+	}
+
+	return 0;
+}
+
+int fp_oper_test()
+{
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	{
+		OPER o({ OPER(1.), OPER(2.), OPER(3.), OPER(4.), OPER(5.), OPER(6.) });
+		o.resize(2, 3);
+		ensure(count_num(o) == 6);
+		FPX a = to_fp(o);
+		ensure(rows(a) == 2 && columns(a) == 3 && a(1, 2) == 6);
+		OPER o2 = to_oper(a);
+		ensure(o2 == o);
+	}
+	{
+		OPER o({ OPER(1.), OPER(), OPER(L"a"), OPER(ErrNA), OPER(true), OPER(6.) });
+		o.resize(3, 2);
+		ensure(count_num(o) == 2);
+		FPX a = to_fp(o);
+		ensure(rows(a) == 3 && columns(a) == 2);
+		ensure(a[0] == 1 && std::isnan(a[1]) && std::isnan(a[4]) && a[5] == 6);
+		FPX b = to_fp(o, convert_policy::skip);
+		ensure(rows(b) == 2 && columns(b) == 1 && b[0] == 1 && b[1] == 6);
+		o.resize(1, 6);
+		b = to_fp(o, convert_policy::skip);
+		ensure(rows(b) == 1 && columns(b) == 2);
+		bool thrown = false;
+		try {
+			to_fp(o, convert_policy::error);
+		}
+		catch (const std::runtime_error& ex) {
+			thrown = std::string(ex.what()).find("(0, 1)") != std::string::npos;
+		}
+		ensure(thrown);
+	}
+	{
+		// Scalars
+		ensure(to_fp(OPER(1.5))[0] == 1.5);
+		ensure(to_fp(Nil, convert_policy::skip).size() == 0);
+		ensure(std::isnan(to_fp(OPER(L"a"))[0]));
+	}
+	{
+		FPX a({ 1, nan, 3 });
+		OPER o = to_oper(a);
+		ensure(o[0] == 1 && o[1] == ErrNum && o[2] == 3);
+		o = to_oper(a, convert_policy::skip);
+		ensure(isNil(o[1]));
+		bool thrown = false;
+		try {
+			to_oper(a, convert_policy::error);
+		}
+		catch (const std::runtime_error&) {
+			thrown = true;
+		}
+		ensure(thrown);
+	}
+	{
+		// Reuse memory and replace strings.
+		OPER o({ OPER(L"abc"), OPER(L"def"), OPER(1.), OPER(2.) });
+		const XLOPER12* p = Multi(o);
+		FPX a({ 4, 3, 2, 1 });
+		to_oper(a, o);
+		ensure(Multi(o) == p && o[0] == 4 && o[3] == 1);
+		FPX b;
+		to_fp(o, b);
+		const double* pb = b.array();
+		to_fp(o, b);
+		ensure(b.array() == pb && b == a);
+	}
+
+	return 0;
+}
+
+int fp_expr_test()
+{
+	{
+		FPX a({ 1, 2, 3, 4 });
+		FPX b({ 5, 6, 7, 8 });
+		a.resize(2, 2);
+		b.resize(2, 2);
+		FPX c = a + b * 2. - 1.;
+		ensure(c.rows() == 2 && c.columns() == 2);
+		ensure(c[0] == 10 && c[3] == 19);
+		c = 1. / (a - b);
+		ensure(c[0] == -0.25);
+		c = -a;
+		ensure(c[1] == -2);
+		c = a / a;
+		ensure(c[0] == 1 && c[3] == 1);
+	}
+	{
+		// Math functions and FP12 arguments.
+		FPX a({ 3, 4 });
+		FPX b({ 4, 3 });
+		const _FP12& fa = *a.get();
+		FPX c = sqrt(expr(fa) * expr(fa) + b * b);
+		ensure(c[0] == 5 && c[1] == 5);
+		c = fmax(a, b) + abs(-b);
+		ensure(c[0] == 8 && c[1] == 7);
+		c = pow(2., a);
+		ensure(c[0] == 8 && c[1] == 16);
+		c = exp(log(a));
+		ensure(std::fabs(c[0] - 3) < 1e-15);
+	}
+	{
+		// Elements of the target may appear in the expression.
+		FPX a({ 1, 2, 3 });
+		a = a * a + a;
+		ensure(a[0] == 2 && a[1] == 6 && a[2] == 12);
+		a += 1.;
+		a *= a;
+		ensure(a[0] == 9 && a[2] == 169);
+		a -= a;
+		ensure(a[0] == 0 && a[2] == 0);
+	}
+	{
+		// Shapes must match.
+		FPX a({ 1, 2, 3 });
+		FPX b({ 1, 2 });
+		bool thrown = false;
+		try {
+			FPX c = a + b;
+		}
+		catch (const std::exception&) {
+			thrown = true;
+		}
+		ensure(thrown);
+	}
 
 	return 0;
 }
@@ -821,10 +2216,25 @@ int WINAPI xll_test()
 		err_test();
 		bool_test();
 		multi_test();
+		builder_test();
+		intern_test();
+		pointer_map_test();
+		concurrent_pointer_map_test();
+		handle_test();
+		slab_test();
+		snapshot_test();
+		hash_test();
+		key_index_test();
+		arena_test();
 		json_test();
 		evaluate_test();
 		excel_test();
 		fp_test();
+		fp_oper_test();
+		fp_expr_test();
+		simd_test();
+		parallel_test();
+		return_buffer_test();
 		excel_time_test();
 	}
 	catch (const std::exception& ex) {
@@ -887,6 +2297,58 @@ _FP12* WINAPI xll_array(_FP12* pa, double s)
 	return pa;
 }
 
+AddIn xai_sequence(
+	Function(XLL_LPOPER, L"xll_sequence", L"XLL.SEQUENCE")
+	.Arguments({
+		Arg(XLL_LONG, L"rows", L"is the number of rows.", 2),
+		Arg(XLL_LONG, L"columns", L"is the number of columns.", 3),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return rows x columns array of 1, 2, ... from a per thread pool given back by xlAutoFree12.")
+);
+LPXLOPER12 WINAPI xll_sequence(LONG r, LONG c)
+{
+#pragma XLLEXPORT
+	auto& pool = dll_free_pool::instance();
+
+	if (r <= 0 || c <= 0) {
+		return pool.dll_free(pool.acquire() = ErrValue);
+	}
+
+	OPER& o = pool.acquire(r, c);
+	for (int i = 0; i < size(o); ++i) {
+		o[i] = 1. + i;
+	}
+
+	return pool.dll_free(o);
+}
+
+AddIn xai_fp_sequence(
+	Function(XLL_FP, L"xll_fp_sequence", L"XLL.FP.SEQUENCE")
+	.Arguments({
+		Arg(XLL_LONG, L"rows", L"is the number of rows.", 2),
+		Arg(XLL_LONG, L"columns", L"is the number of columns.", 3),
+		})
+	.ThreadSafe()
+	.Category(L"XLL")
+	.FunctionHelp(L"Return rows x columns array of 1, 2, ... from a per thread buffer.")
+);
+_FP12* WINAPI xll_fp_sequence(LONG r, LONG c)
+{
+#pragma XLLEXPORT
+	if (r <= 0 || c <= 0) {
+		return nullptr;
+	}
+
+	FPX& a = return_fp(r, c);
+	for (int i = 0; i < a.size(); ++i) {
+		a[i] = 1. + i;
+	}
+
+	return a.get();
+}
+
 AddIn xai_relref(
 	Function(XLL_LPOPER, L"xll_relref", L"XLL.RELREF")
 	.Arguments({
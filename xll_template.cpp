@@ -1,6 +1,7 @@
 ﻿// xll_template.cpp - Sample xll project.
 #include <cmath> // for `double tgamma(double)`
 #include "xll_template.h"
+#include "xll24/include/parallel.h"
 
 using namespace xll;
 
@@ -26,6 +27,29 @@ double WINAPI xll_tgamma(double x)
 	return tgamma(x);
 }
 
+AddIn xai_tgamma_array(
+	// FP12 arrays are two dimensional arrays of doubles.
+	Function(XLL_FP, "xll_tgamma_array", "TGAMMA.ARRAY")
+	.Arguments({
+		Arg(XLL_FP, "x", "is an array of values for which you want to calculate Gamma.")
+		})
+	// Excel can call this from several calculation threads at once.
+	.ThreadSafe()
+	.FunctionHelp("Return the Gamma function value of every element of an array.")
+	.Category("MATH")
+	.HelpTopic("https://docs.microsoft.com/en-us/cpp/c-runtime-library/reference/tgamma-tgammaf-tgammal")
+);
+_FP12* WINAPI xll_tgamma_array(_FP12* px)
+{
+#pragma XLLEXPORT
+	// Excel owns the argument so results go in a per thread buffer.
+	FPX& y = return_fp(px->rows, px->columns);
+	// Large arrays are split across cores.
+	parallel_transform(span(*px), span(*y.get()), [](double x) { return tgamma(x); });
+
+	return y.get();
+}
+
 // Press Alt-F8 then type 'XLL.MACRO' to call 'xll_macro'
 // See https://xlladdins.github.io/Excel4Macros/
 AddIn xai_macro(